@@ -0,0 +1,978 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "CommandBuffer.h"
+#include "MMU.h"
+#include <algorithm>
+
+namespace RetroSim::GPU
+{
+    CommandBuffer commandBuffer;
+
+    const uint32_t initialArenaSize = 64 * 1024;
+
+    template <typename T>
+    T ReadCommand(const uint8_t *source)
+    {
+        T command;
+        memcpy(&command, source, sizeof(T));
+        return command;
+    }
+
+    uint64_t HashMemory(uint64_t hash, const uint8_t *data, size_t size)
+    {
+        // FNV-1a over 64-bit words; the hashed regions are all multiples of 8 bytes
+        for (size_t i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(uint64_t));
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
+    struct MemorySection
+    {
+        MemoryReference reference;
+        uint32_t address;
+        uint32_t size;
+    };
+
+    const MemorySection memorySections[] = {
+        {REFERENCES_MAP, MMU::MAP_U8, MMU::TILES_U8 - MMU::MAP_U8},
+        {REFERENCES_TILES, MMU::TILES_U8, MMU::SPRITE_ATLAS_U8 - MMU::TILES_U8},
+        {REFERENCES_SPRITE_ATLAS, MMU::SPRITE_ATLAS_U8, MMU::GPU_REGISTERS - MMU::SPRITE_ATLAS_U8},
+        {REFERENCES_BITMAP, MMU::BITMAP_U8, MMU::CHARSET_U8 - MMU::BITMAP_U8},
+        {REFERENCES_CHARSET, MMU::CHARSET_U8, 0x10000},
+        {REFERENCES_TEXT, MMU::TEXT_SCREEN_U8, MMU::BITMAP_U8 - MMU::TEXT_SCREEN_U8},
+        {REFERENCES_SPRITE_ATTRIBUTES, MMU::SPRITE_ATTRIBUTES, MMU::spriteCount * sizeof(MMU::SpriteAttributes)},
+        {REFERENCES_TILE_LAYERS, MMU::TILE_LAYERS, MMU::tileLayerCount * (sizeof(MMU::TileLayerRegisters) + sizeof(MMU::AffineLayerRegisters))},
+    };
+
+    // Only the state that affects rasterization is compared, the palette is compared separately.
+    // The target isn't compared, it always starts out as a copy of the previous output.
+    bool IsSameState(const Rasterizer::RenderState &a, const Rasterizer::RenderState &b)
+    {
+        return a.clipX0 == b.clipX0 && a.clipY0 == b.clipY0 && a.clipX1 == b.clipX1 && a.clipY1 == b.clipY1 &&
+               a.fontWidth == b.fontWidth && a.fontHeight == b.fontHeight && a.fontOffset == b.fontOffset &&
+               a.blendMode == b.blendMode && a.stencilMode == b.stencilMode;
+    }
+
+    // How far a copy moves the pixels, the destination is the rectangle in the command's header.
+    void GetCopyOffset(uint16_t id, const uint8_t *source, int &dx, int &dy)
+    {
+        if (id == ScrollID)
+        {
+            auto c = ReadCommand<ScrollCommand>(source);
+            dx = c.dx;
+            dy = c.dy;
+        }
+        else
+        {
+            auto c = ReadCommand<CopyRectCommand>(source);
+            dx = (int)((int64_t)c.dstX - c.srcX);
+            dy = (int)((int64_t)c.dstY - c.srcY);
+        }
+    }
+
+    CommandBuffer::CommandBuffer()
+    {
+        recordFrame.arena.resize(initialArenaSize);
+        renderFrame.arena.resize(initialArenaSize);
+        previousArena.resize(initialArenaSize);
+        recordFrame.memory.resize(MMU::memorySize);
+        renderFrame.memory.resize(MMU::memorySize);
+        bandStates.resize(1);
+        bandFillBuffers.resize(1);
+        stencil.resize(textureHeight * Rasterizer::stencilRowWords);
+        tileCaches.push_back(std::make_unique<TileCache>(tileMemoryTracker));
+    }
+
+    CommandBuffer::~CommandBuffer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameSubmitted.notify_one();
+
+        if (renderThread.joinable())
+            renderThread.join();
+    }
+
+    uint8_t *CommandBuffer::Allocate(uint32_t size)
+    {
+        Frame &frame = recordFrame;
+
+        // The palette is captured when the first command of the frame is recorded, in the output format, palette
+        // changes made through SetPaletteColor afterwards are replayed in order.
+        if (frame.used == 0)
+            Rasterizer::ConvertPalette(frame.palette, MMU::memory.Palette_u32, recordState.outputFormat);
+
+        if (frame.used + size > frame.arena.size())
+            frame.arena.resize(std::max(frame.arena.size() * 2, (size_t)(frame.used + size)));
+
+        uint8_t *destination = frame.arena.data() + frame.used;
+        frame.used += size;
+        frame.stats.bytesRecorded = frame.used;
+
+        return destination;
+    }
+
+    // Commands that only change the render state and don't draw anything.
+    bool CommandBuffer::IsStateCommand(uint16_t id)
+    {
+        switch (id)
+        {
+        case SetFontID:
+        case SetPaletteColorID:
+        case SetClippingID:
+        case DisableClippingID:
+        case SetBlendModeID:
+        case SetStencilModeID:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Besides culling, this stores the rectangle the command can draw to in the header. Bands skip
+    // the commands outside of them and the rectangle is added to the frame's dirty region.
+    bool CommandBuffer::IsCulled(APICalls id, const void *command, CommandHeader &header)
+    {
+        header.left = 0;
+        header.top = 0;
+        header.right = textureWidth - 1;
+        header.bottom = textureHeight - 1;
+
+        int64_t x0, y0, x1, y1;
+        const uint8_t *source = (const uint8_t *)command;
+
+        switch (id)
+        {
+        case RenderTextID:
+        case RenderOpaqueTextID:
+        {
+            auto c = ReadCommand<RenderTextCommand>(source);
+            x0 = c.x;
+            y0 = c.y;
+            x1 = c.x + (int64_t)c.length * recordState.fontWidth - 1;
+            y1 = c.y + recordState.fontHeight - 1;
+            break;
+        }
+        case DrawPixelID:
+        {
+            auto c = ReadCommand<DrawPixelCommand>(source);
+            x0 = x1 = c.x;
+            y0 = y1 = c.y;
+            break;
+        }
+        case DrawLineID:
+        {
+            auto c = ReadCommand<DrawLineCommand>(source);
+            x0 = std::min(c.x0, c.x1);
+            y0 = std::min(c.y0, c.y1);
+            x1 = std::max(c.x0, c.x1);
+            y1 = std::max(c.y0, c.y1);
+            break;
+        }
+        case DrawRectID:
+        {
+            auto c = ReadCommand<DrawRectCommand>(source);
+            x0 = std::min<int64_t>(c.x, (int64_t)c.x + c.width);
+            y0 = std::min<int64_t>(c.y, (int64_t)c.y + c.height);
+            x1 = std::max<int64_t>(c.x, (int64_t)c.x + c.width);
+            y1 = std::max<int64_t>(c.y, (int64_t)c.y + c.height);
+            break;
+        }
+        case DrawPixelsID:
+        case DrawPolylineID:
+        case DrawRectsID:
+        case FillPolygonID:
+        {
+            auto c = ReadCommand<DrawBatchCommand>(source);
+            x0 = c.left;
+            y0 = c.top;
+            x1 = c.right;
+            y1 = c.bottom;
+            break;
+        }
+        case DrawCircleID:
+        {
+            auto c = ReadCommand<DrawCircleCommand>(source);
+            x0 = (int64_t)c.x - c.radius;
+            y0 = (int64_t)c.y - c.radius;
+            x1 = (int64_t)c.x + c.radius;
+            y1 = (int64_t)c.y + c.radius;
+            break;
+        }
+        case DrawTriangleID:
+        {
+            auto c = ReadCommand<DrawTriangleCommand>(source);
+            x0 = std::min({c.x0, c.x1, c.x2});
+            y0 = std::min({c.y0, c.y1, c.y2});
+            x1 = std::max({c.x0, c.x1, c.x2});
+            y1 = std::max({c.y0, c.y1, c.y2});
+            break;
+        }
+        case DrawMapID:
+        {
+            auto c = ReadCommand<DrawMapCommand>(source);
+            x0 = c.screenX;
+            y0 = c.screenY;
+            x1 = c.screenX + (int64_t)c.width * c.tileWidth - 1;
+            y1 = c.screenY + (int64_t)c.height * c.tileHeight - 1;
+            break;
+        }
+        case DrawSpriteID:
+        {
+            auto c = ReadCommand<DrawSpriteCommand>(source);
+            x0 = c.x;
+            y0 = c.y;
+            x1 = (int64_t)c.x + c.width - 1;
+            y1 = (int64_t)c.y + c.height - 1;
+            break;
+        }
+        case DrawTransformedSpriteID:
+        {
+            auto c = ReadCommand<DrawTransformedSpriteCommand>(source);
+            x0 = c.left;
+            y0 = c.top;
+            x1 = c.right;
+            y1 = c.bottom;
+            break;
+        }
+        case DrawBitmapID:
+        {
+            auto c = ReadCommand<DrawBitmapCommand>(source);
+            x0 = c.screenPosX;
+            y0 = c.screenPosY;
+            x1 = (int64_t)c.screenPosX + c.width - 1;
+            y1 = (int64_t)c.screenPosY + c.height - 1;
+            break;
+        }
+        case CopyRectID:
+        {
+            // the part of the destination whose source is inside the frame buffer
+            auto c = ReadCommand<CopyRectCommand>(source);
+            int64_t dx = (int64_t)c.dstX - c.srcX;
+            int64_t dy = (int64_t)c.dstY - c.srcY;
+            x0 = std::max<int64_t>(c.dstX, dx);
+            y0 = std::max<int64_t>(c.dstY, dy);
+            x1 = std::min<int64_t>((int64_t)c.dstX + c.width - 1, dx + textureWidth - 1);
+            y1 = std::min<int64_t>((int64_t)c.dstY + c.height - 1, dy + textureHeight - 1);
+            break;
+        }
+        case ScrollID:
+        {
+            // the clipping rectangle moved
+            auto c = ReadCommand<ScrollCommand>(source);
+            x0 = (int64_t)recordState.clipX0 + c.dx;
+            y0 = (int64_t)recordState.clipY0 + c.dy;
+            x1 = (int64_t)recordState.clipX1 + c.dx;
+            y1 = (int64_t)recordState.clipY1 + c.dy;
+            break;
+        }
+        case FloodFillID:
+        {
+            // fills from the seed up to the edges of the clipping rectangle
+            auto c = ReadCommand<FloodFillCommand>(source);
+            if (c.x < recordState.clipX0 || c.x > recordState.clipX1 || c.y < recordState.clipY0 || c.y > recordState.clipY1)
+                return true;
+
+            header.left = (int16_t)recordState.clipX0;
+            header.top = (int16_t)recordState.clipY0;
+            header.right = (int16_t)recordState.clipX1;
+            header.bottom = (int16_t)recordState.clipY1;
+            return false;
+        }
+        case DrawFramebufferID:
+        {
+            // isn't clipped, like the layers
+            auto c = ReadCommand<DrawFramebufferCommand>(source);
+            header.right = (int16_t)(recordState.screenWidth - 1);
+            header.top = (int16_t)c.firstRow;
+            header.bottom = (int16_t)c.lastRow;
+            return false;
+        }
+        case ClearScreenID:
+        case ClearStencilID:
+            // fills the clipping rectangle
+            if (recordState.clipX0 > recordState.clipX1 || recordState.clipY0 > recordState.clipY1)
+                return true;
+            header.left = (int16_t)recordState.clipX0;
+            header.top = (int16_t)recordState.clipY0;
+            header.right = (int16_t)recordState.clipX1;
+            header.bottom = (int16_t)recordState.clipY1;
+            return false;
+        default:
+            // state changes and screen clears are never culled
+            return false;
+        }
+
+        if (x1 < x0 || y1 < y0 ||
+            x1 < recordState.clipX0 || x0 > recordState.clipX1 ||
+            y1 < recordState.clipY0 || y0 > recordState.clipY1)
+            return true;
+
+        header.left = (int16_t)std::max<int64_t>(x0, recordState.clipX0);
+        header.top = (int16_t)std::max<int64_t>(y0, recordState.clipY0);
+        header.right = (int16_t)std::min<int64_t>(x1, recordState.clipX1);
+        header.bottom = (int16_t)std::min<int64_t>(y1, recordState.clipY1);
+
+        return false;
+    }
+
+    void CommandBuffer::TrackState(APICalls id, const void *command, const CommandHeader &header)
+    {
+        const uint8_t *source = (const uint8_t *)command;
+
+        switch (id)
+        {
+        case SetFontID:
+        {
+            auto c = ReadCommand<SetFontCommand>(source);
+            Rasterizer::SetFont(recordState, c.width, c.height, c.offset);
+            break;
+        }
+        case SetClippingID:
+        {
+            auto c = ReadCommand<SetClippingCommand>(source);
+            Rasterizer::SetClipping(recordState, c.x0, c.y0, c.x1, c.y1);
+            break;
+        }
+        case DisableClippingID:
+            Rasterizer::DisableClipping(recordState);
+            break;
+        case SetBlendModeID:
+            Rasterizer::SetBlendMode(recordState, ReadCommand<SetBlendModeCommand>(source).mode);
+            break;
+        case SetStencilModeID:
+            Rasterizer::SetStencilMode(recordState, ReadCommand<SetStencilModeCommand>(source).mode);
+            break;
+        case ClearStencilID:
+            // no pixel changes
+            return;
+        case RenderTextID:
+        case RenderOpaqueTextID:
+            recordFrame.memoryReferences |= REFERENCES_CHARSET;
+            break;
+        case SetPaletteColorID:
+            recordFrame.paletteCommandCount++;
+            break;
+        case DrawMapID:
+            recordFrame.memoryReferences |= REFERENCES_MAP | REFERENCES_TILES;
+            break;
+        case DrawSpriteID:
+        case DrawTransformedSpriteID:
+            recordFrame.memoryReferences |= REFERENCES_SPRITE_ATLAS;
+            break;
+        case DrawBitmapID:
+            recordFrame.memoryReferences |= REFERENCES_BITMAP;
+            break;
+        case DrawTileLayersID:
+            recordFrame.memoryReferences |= REFERENCES_TILE_LAYERS | REFERENCES_MAP | REFERENCES_TILES;
+            if (ReadCommand<DrawTileLayersCommand>(source).readsBitmap)
+                recordFrame.memoryReferences |= REFERENCES_BITMAP;
+            // the compositor adds the rows of the old and the new layers to the dirty region
+            return;
+        case DrawTextLayerID:
+            recordFrame.memoryReferences |= REFERENCES_TEXT | REFERENCES_CHARSET;
+            recordFrame.textLayer = ReadCommand<DrawTextLayerCommand>(source);
+            // only the cells that change are drawn, the render thread adds them to the dirty region
+            return;
+        case DrawSpriteLayerID:
+            recordFrame.memoryReferences |= REFERENCES_SPRITE_ATLAS | REFERENCES_SPRITE_ATTRIBUTES;
+            // the sprite engine adds the rows of the old and the new sprites to the dirty region
+            return;
+        case DrawScanlineLayerID:
+            // the lines are composed on the CPU thread, the render thread adds them to the dirty region
+            return;
+        case CopyRectID:
+        case ScrollID:
+        {
+            recordFrame.readsTarget = true;
+            int dx, dy;
+            GetCopyOffset(id, source, dx, dy);
+            if (dy != 0)
+                recordFrame.frameCommandCount++;
+            break;
+        }
+        case FloodFillID:
+            recordFrame.readsTarget = true;
+            recordFrame.frameCommandCount++;
+            break;
+        default:
+            break;
+        }
+
+        if (!IsStateCommand(id))
+        {
+            recordFrame.dirtyRegion.Mark(header.left, header.top, header.right, header.bottom);
+            recordFrame.readsTarget |= recordState.blendMode != BLEND_NONE || recordState.stencilMode == STENCIL_INSIDE || recordState.stencilMode == STENCIL_OUTSIDE;
+        }
+    }
+
+    // The CPU keeps on changing the memory while the frame is rendered, so the sections
+    // the frame reads are copied at the end of the frame.
+    void CommandBuffer::TakeMemorySnapshot(Frame &frame)
+    {
+        for (const MemorySection &section : memorySections)
+            if (frame.memoryReferences & section.reference)
+                memcpy(frame.memory.data() + section.address, MMU::memory.raw + section.address, section.size);
+    }
+
+    uint64_t CommandBuffer::HashReferencedMemory(const Frame &frame)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+
+        for (const MemorySection &section : memorySections)
+            if (frame.memoryReferences & section.reference)
+                hash = HashMemory(hash, frame.memory.data() + section.address, section.size);
+
+        return hash;
+    }
+
+    void CommandBuffer::ExecuteCommand(Rasterizer::RenderState &state, const CommandHeader *header)
+    {
+        const uint8_t *source = (const uint8_t *)header + sizeof(CommandHeader);
+
+        switch (header->id)
+        {
+        case SetFontID:
+        {
+            auto c = ReadCommand<SetFontCommand>(source);
+            Rasterizer::SetFont(state, c.width, c.height, c.offset);
+            break;
+        }
+        case SetPaletteColorID:
+        {
+            auto c = ReadCommand<SetPaletteColorCommand>(source);
+            Rasterizer::SetPaletteColor(state, c.index, c.color);
+            break;
+        }
+        case RenderTextID:
+        {
+            auto c = ReadCommand<RenderTextCommand>(source);
+            Rasterizer::RenderText(state, (const char *)source + sizeof(RenderTextCommand), c.length, c.x, c.y, c.colorIndex);
+            break;
+        }
+        case RenderOpaqueTextID:
+        {
+            auto c = ReadCommand<RenderTextCommand>(source);
+            Rasterizer::RenderOpaqueText(state, (const char *)source + sizeof(RenderTextCommand), c.length, c.x, c.y, c.colorIndex, c.backgroundColorIndex);
+            break;
+        }
+        case ClearScreenID:
+            Rasterizer::ClearScreen(state, ReadCommand<ClearScreenCommand>(source).colorIndex);
+            break;
+        case ClearScreenIgnoreClippingID:
+            Rasterizer::ClearScreenIgnoreClipping(state, ReadCommand<ClearScreenCommand>(source).colorIndex);
+            break;
+        case DrawPixelID:
+        {
+            auto c = ReadCommand<DrawPixelCommand>(source);
+            Rasterizer::DrawPixel(state, c.x, c.y, c.colorIndex);
+            break;
+        }
+        case DrawLineID:
+        {
+            auto c = ReadCommand<DrawLineCommand>(source);
+            Rasterizer::DrawLine(state, c.x0, c.y0, c.x1, c.y1, c.colorIndex);
+            break;
+        }
+        case DrawRectID:
+        {
+            auto c = ReadCommand<DrawRectCommand>(source);
+            Rasterizer::DrawRect(state, c.x, c.y, c.width, c.height, c.colorIndex, c.filled);
+            break;
+        }
+        case DrawPixelsID:
+        {
+            auto c = ReadCommand<DrawBatchCommand>(source);
+            Rasterizer::DrawPixels(state, (const int32_t *)(source + sizeof(DrawBatchCommand)), c.count, c.colorIndex);
+            break;
+        }
+        case DrawPolylineID:
+        {
+            auto c = ReadCommand<DrawBatchCommand>(source);
+            Rasterizer::DrawPolyline(state, (const int32_t *)(source + sizeof(DrawBatchCommand)), c.count, c.colorIndex, c.flag);
+            break;
+        }
+        case DrawRectsID:
+        {
+            auto c = ReadCommand<DrawBatchCommand>(source);
+            Rasterizer::DrawRects(state, (const int32_t *)(source + sizeof(DrawBatchCommand)), c.count, c.colorIndex, c.flag);
+            break;
+        }
+        case FillPolygonID:
+        {
+            auto c = ReadCommand<DrawBatchCommand>(source);
+            Rasterizer::FillPolygon(state, (const int32_t *)(source + sizeof(DrawBatchCommand)), c.count, c.colorIndex);
+            break;
+        }
+        case FloodFillID:
+        {
+            auto c = ReadCommand<FloodFillCommand>(source);
+            Rasterizer::FloodFill(state, c.x, c.y, c.colorIndex);
+            break;
+        }
+        case DrawCircleID:
+        {
+            auto c = ReadCommand<DrawCircleCommand>(source);
+            Rasterizer::DrawCircle(state, c.x, c.y, c.radius, c.colorIndex, c.filled);
+            break;
+        }
+        case DrawTriangleID:
+        {
+            auto c = ReadCommand<DrawTriangleCommand>(source);
+            Rasterizer::DrawTriangle(state, c.x0, c.y0, c.x1, c.y1, c.x2, c.y2, c.colorIndex, c.filled);
+            break;
+        }
+        case DrawMapID:
+        {
+            auto c = ReadCommand<DrawMapCommand>(source);
+            Rasterizer::DrawMap(state, c.screenX, c.screenY, c.mapX, c.mapY, c.width, c.height, c.transparentColorIndex, c.tileWidth, c.tileHeight, c.mapWidth);
+            break;
+        }
+        case DrawSpriteID:
+        {
+            auto c = ReadCommand<DrawSpriteCommand>(source);
+            Rasterizer::DrawSprite(state, c.x, c.y, c.spriteX, c.spriteY, c.width, c.height, c.transparentColorIndex, c.pitch);
+            break;
+        }
+        case DrawTransformedSpriteID:
+        {
+            auto c = ReadCommand<DrawTransformedSpriteCommand>(source);
+            Rasterizer::DrawTransformedSprite(state, c.x, c.y, c.spriteX, c.spriteY, c.width, c.height, c.matrix, c.left, c.top, c.right, c.bottom, c.transparentColorIndex, c.pitch);
+            break;
+        }
+        case DrawBitmapID:
+        {
+            auto c = ReadCommand<DrawBitmapCommand>(source);
+            Rasterizer::DrawBitmap(state, c.screenPosX, c.screenPosY, c.bitmapPosX, c.bitmapPosY, c.width, c.height, c.pitch, c.transparentColorIndex);
+            break;
+        }
+        case SetClippingID:
+        {
+            auto c = ReadCommand<SetClippingCommand>(source);
+            Rasterizer::SetClipping(state, c.x0, c.y0, c.x1, c.y1);
+            break;
+        }
+        case DisableClippingID:
+            Rasterizer::DisableClipping(state);
+            break;
+        case SetBlendModeID:
+            Rasterizer::SetBlendMode(state, ReadCommand<SetBlendModeCommand>(source).mode);
+            break;
+        case SetStencilModeID:
+            Rasterizer::SetStencilMode(state, ReadCommand<SetStencilModeCommand>(source).mode);
+            break;
+        case ClearStencilID:
+            Rasterizer::ClearStencil(state, ReadCommand<ClearStencilCommand>(source).value);
+            break;
+        case CopyRectID:
+        case ScrollID:
+        {
+            int dx, dy;
+            GetCopyOffset(header->id, source, dx, dy);
+            Rasterizer::CopyRect(state, header->left, header->top, header->right, header->bottom, dx, dy);
+            break;
+        }
+        case DrawTileLayersID:
+        {
+            int count;
+            const uint8_t *order = tileLayers.GetOrder(count);
+            tileLayers.SaveBackground(state.target, state.bandY0, state.bandY1);
+            Rasterizer::DrawTileLayers(state, tileLayers.GetLayers(), tileLayers.GetAffineLayers(), order, count);
+            break;
+        }
+        case DrawTextLayerID:
+        {
+            auto c = ReadCommand<DrawTextLayerCommand>(source);
+            Rasterizer::DrawTextLayer(state, textLayer.GetRedrawCells(), c.fontHeight, c.backgroundColorIndex);
+            break;
+        }
+        case DrawSpriteLayerID:
+        {
+            auto c = ReadCommand<DrawSpriteLayerCommand>(source);
+            spriteEngine.SaveBackground(state.target, state.bandY0, state.bandY1);
+            Rasterizer::DrawSpriteLayer(state, spriteEngine, c.atlasPitch);
+            break;
+        }
+        case DrawFramebufferID:
+            Rasterizer::DrawFramebuffer(state, source + sizeof(DrawFramebufferCommand));
+            break;
+        case DrawScanlineLayerID:
+            scanlineBackground.Save(state.target, state.bandY0, state.bandY1);
+            renderFrame.scanlineLayer.Draw(state.target, state.bandY0, state.bandY1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void CommandBuffer::Submit(TripleBuffer &output)
+    {
+        WaitUntilIdle();
+
+        // with layers on the screen even an empty frame changes the output, it removes them, and so does a new video mode
+        if (recordFrame.used == 0 && !tileLayers.IsVisible() && !spriteEngine.IsVisible() && !scanlineBackground.IsVisible() &&
+            recordState.videoMode == submittedVideoMode)
+        {
+            lastFrameStats = recordFrame.stats;
+            recordFrame.stats = CommandBufferStats();
+            return;
+        }
+
+        TakeMemorySnapshot(recordFrame);
+        recordFrame.videoMode = recordState.videoMode;
+        submittedVideoMode = recordState.videoMode;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(recordFrame, renderFrame);
+            this->output = &output;
+            framePending = true;
+            resultPending = true;
+
+            if (!renderThread.joinable())
+                renderThread = std::thread(&CommandBuffer::RenderLoop, this);
+        }
+        frameSubmitted.notify_one();
+
+        recordFrame.used = 0;
+        recordFrame.memoryReferences = 0;
+        recordFrame.paletteCommandCount = 0;
+        recordFrame.readsTarget = false;
+        recordFrame.frameCommandCount = 0;
+        recordFrame.scanlineLayer.Clear();
+        recordFrame.dirtyRegion.Clear();
+        recordFrame.stats = CommandBufferStats();
+    }
+
+    void CommandBuffer::WaitForFrame()
+    {
+        WaitUntilIdle();
+
+        if (!resultPending)
+            return;
+
+        resultPending = false;
+        lastFrameStats = renderFrame.stats;
+    }
+
+    void CommandBuffer::WaitUntilIdle()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        frameFinished.wait(lock, [this] { return !framePending; });
+    }
+
+    void CommandBuffer::RenderLoop()
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameSubmitted.wait(lock, [this] { return framePending || stopping; });
+                if (stopping)
+                    return;
+            }
+
+            Execute();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                framePending = false;
+            }
+            frameFinished.notify_all();
+        }
+    }
+
+    // Runs on the render thread.
+    void CommandBuffer::Execute()
+    {
+        Frame &frame = renderFrame;
+
+        // Drawing only overwrites pixels, so running the same commands on the same inputs again
+        // would produce the same frame buffer. In that case the previous output is kept as is.
+        // Lines composed in scanline mode aren't compared, a frame with them is always rendered,
+        // and so is a frame that reads its target (blends, copies, flood fills), as doing those twice differs from doing them once.
+        uint64_t memoryHash = HashReferencedMemory(frame);
+        bool videoModeChanged = frame.videoMode != executeState.videoMode;
+        bool identical = previousFrameValid &&
+                         !videoModeChanged &&
+                         frame.scanlineLayer.IsEmpty() &&
+                         !frame.readsTarget &&
+                         frame.used == previousUsed &&
+                         memoryHash == previousMemoryHash &&
+                         IsSameState(executeState, previousStartState) &&
+                         memcmp(frame.palette, previousPalette, sizeof(previousPalette)) == 0 &&
+                         memcmp(frame.arena.data(), previousArena.data(), frame.used) == 0;
+
+        if (!identical)
+        {
+            // the new mode starts on a cleared screen, the layers are drawn again from scratch
+            startsCleared = videoModeChanged;
+            if (videoModeChanged)
+            {
+                Rasterizer::SetVideoMode(executeState, frame.videoMode);
+                textLayer.Invalidate();
+                tileLayers.Invalidate();
+                spriteEngine.Invalidate();
+                scanlineBackground.Invalidate();
+                frame.dirtyRegion.MarkAll();
+            }
+
+            previousStartState = executeState;
+            renderTarget = output->GetWriteBuffer();
+            previousOutput = output->GetLastPublishedBuffer();
+            UpdateTileCacheState();
+
+            Rasterizer::RenderState endState = executeState;
+            ApplyStateChanges(endState);
+
+            // the layers cover only the screen
+            int screenWidth = executeState.screenWidth;
+            int screenHeight = executeState.screenHeight;
+
+            // before the text layer, which redraws the cells the tile layers' background is restored to
+            tileLayers.Prepare((frame.memoryReferences & REFERENCES_TILE_LAYERS) ? frame.memory.data() : nullptr, screenWidth, screenHeight, frame.dirtyRegion);
+
+            if (frame.memoryReferences & REFERENCES_TEXT)
+                textLayer.Prepare(frame.memory.data(), screenWidth, screenHeight, frame.textLayer.fontHeight, frame.textLayer.backgroundColorIndex, endState.palette, frame.dirtyRegion);
+            else
+                textLayer.Invalidate();
+
+            spriteEngine.Prepare((frame.memoryReferences & REFERENCES_SPRITE_ATTRIBUTES) ? frame.memory.data() : nullptr, screenWidth, screenHeight, frame.dirtyRegion);
+
+            scanlineBackground.BeginFrame();
+            frame.scanlineLayer.Cover(scanlineBackground);
+            scanlineBackground.MarkDirty(frame.dirtyRegion);
+
+            // only the rows of the screen are drawn
+            int bandCount = workerPool.GetThreadCount();
+            int bandHeight = (screenHeight + bandCount - 1) / bandCount;
+
+            // A copy that moves pixels between rows or a flood fill reads the rows of other bands. The commands
+            // before it are finished on every band, then it runs on the whole frame, then the bands continue.
+            Rasterizer::RenderState frameState;
+            frameState.target = renderTarget;
+            frameState.fillBuffers = &frameFillBuffers;
+
+            for (uint32_t begin = 0;;)
+            {
+                uint32_t end = FindFrameCommand(begin);
+                workerPool.Run([this, screenHeight, bandHeight, begin, end](int band)
+                {
+                    int y0 = band * bandHeight;
+                    int y1 = std::min(y0 + bandHeight, screenHeight) - 1;
+                    if (y0 > y1)
+                        return;
+                    if (begin == 0)
+                        BeginBand(band, y0, y1);
+                    ExecuteBand(band, begin, end);
+                });
+
+                if (end == frame.used)
+                    break;
+
+                // it is clipped to the rectangle in its header and uses the palette the bands got to
+                const CommandHeader *header = (const CommandHeader *)(frame.arena.data() + end);
+                memcpy(frameState.palette, bandStates[0].palette, sizeof(frameState.palette));
+                Rasterizer::SetClipping(frameState, header->left, header->top, header->right, header->bottom);
+                ExecuteCommand(frameState, header);
+                begin = end + header->size;
+            }
+
+            executeState = endState;
+            output->Publish(frame.dirtyRegion, executeState.videoMode);
+
+            memcpy(previousPalette, frame.palette, sizeof(previousPalette));
+            previousMemoryHash = memoryHash;
+            previousUsed = frame.used;
+            std::swap(frame.arena, previousArena);
+            previousFrameValid = true;
+        }
+
+        frame.stats.identicalToPreviousFrame = identical;
+    }
+
+    // Copies that move pixels between rows and flood fills.
+    bool CommandBuffer::IsFrameCommand(const CommandHeader *header)
+    {
+        if (header->id == FloodFillID)
+            return true;
+        if (header->id != CopyRectID && header->id != ScrollID)
+            return false;
+
+        int dx, dy;
+        GetCopyOffset(header->id, (const uint8_t *)header + sizeof(CommandHeader), dx, dy);
+        return dy != 0;
+    }
+
+    // Returns the offset of the first command at or after offset that has to run on the whole frame, or the end of the frame.
+    uint32_t CommandBuffer::FindFrameCommand(uint32_t offset)
+    {
+        const Frame &frame = renderFrame;
+        if (frame.frameCommandCount == 0)
+            return frame.used;
+
+        for (; offset < frame.used; offset += ((const CommandHeader *)(frame.arena.data() + offset))->size)
+            if (IsFrameCommand((const CommandHeader *)(frame.arena.data() + offset)))
+                return offset;
+
+        return frame.used;
+    }
+
+    // Sets up the rows [y0, y1] for the frame. The bands use their own copy of the start state,
+    // so they don't depend on each other and can be rendered in parallel.
+    void CommandBuffer::BeginBand(int band, int y0, int y1)
+    {
+        const Frame &frame = renderFrame;
+
+        // the frame is drawn on top of the previous output
+        if (startsCleared)
+            std::fill(renderTarget + y0 * textureWidth, renderTarget + (y1 + 1) * textureWidth, 0xFF000000);
+        else
+            memcpy(renderTarget + y0 * textureWidth, previousOutput + y0 * textureWidth, (y1 - y0 + 1) * textureWidth * sizeof(uint32_t));
+        // the layers are drawn as tile layers, sprites, composed lines and restored in the reverse order
+        scanlineBackground.Restore(renderTarget, y0, y1);
+        spriteEngine.RestoreBackground(renderTarget, y0, y1);
+        tileLayers.RestoreBackground(renderTarget, y0, y1);
+
+        Rasterizer::RenderState &state = bandStates[band];
+        state = executeState;
+        state.target = renderTarget;
+        state.map = frame.memory.data() + MMU::MAP_U8;
+        state.tiles = frame.memory.data() + MMU::TILES_U8;
+        state.spriteAtlas = frame.memory.data() + MMU::SPRITE_ATLAS_U8;
+        state.bitmap = frame.memory.data() + MMU::BITMAP_U8;
+        state.charset = frame.memory.data() + MMU::CHARSET_U8;
+        state.textScreen = frame.memory.data() + MMU::TEXT_SCREEN_U8;
+        state.textColors = frame.memory.data() + MMU::TEXT_COLOR_U8;
+        memcpy(state.palette, frame.palette, sizeof(frame.palette));
+        state.paletteVersion = framePaletteVersion;
+        state.nextPaletteVersion = firstCommandPaletteVersion;
+        state.tileCache = tileCaches[band].get();
+        state.fillBuffers = &bandFillBuffers[band];
+        state.stencil = stencil.data();
+        Rasterizer::SetBand(state, y0, y1);
+    }
+
+    // Runs the commands in [begin, end) of the frame on the band's rows.
+    void CommandBuffer::ExecuteBand(int band, uint32_t begin, uint32_t end)
+    {
+        const Frame &frame = renderFrame;
+        Rasterizer::RenderState &state = bandStates[band];
+
+        for (uint32_t offset = begin; offset < end;)
+        {
+            const CommandHeader *header = (const CommandHeader *)(frame.arena.data() + offset);
+            if (header->bottom >= state.bandY0 && header->top <= state.bandY1)
+                ExecuteCommand(state, header);
+            offset += header->size;
+        }
+    }
+
+    // Lets the tile caches know what changed since the previous frame, before the bands start using them.
+    void CommandBuffer::UpdateTileCacheState()
+    {
+        const Frame &frame = renderFrame;
+
+        if (frame.memoryReferences & REFERENCES_TILES)
+            tileMemoryTracker.Update(frame.memory.data() + MMU::TILES_U8);
+
+        if (memcmp(frame.palette, versionedPalette, sizeof(versionedPalette)) != 0)
+        {
+            memcpy(versionedPalette, frame.palette, sizeof(versionedPalette));
+            framePaletteVersion = nextPaletteVersion++;
+        }
+
+        // every SetPaletteColor command of the frame gets a version of its own
+        firstCommandPaletteVersion = nextPaletteVersion;
+        nextPaletteVersion += frame.paletteCommandCount;
+    }
+
+    // Brings the render state to where the frame leaves it, without drawing anything.
+    void CommandBuffer::ApplyStateChanges(Rasterizer::RenderState &state)
+    {
+        const Frame &frame = renderFrame;
+        memcpy(state.palette, frame.palette, sizeof(frame.palette));
+
+        for (uint32_t offset = 0; offset < frame.used;)
+        {
+            const CommandHeader *header = (const CommandHeader *)(frame.arena.data() + offset);
+            if (IsStateCommand(header->id))
+                ExecuteCommand(state, header);
+            offset += header->size;
+        }
+    }
+
+    void CommandBuffer::Invalidate()
+    {
+        WaitUntilIdle();
+        previousFrameValid = false;
+        textLayer.Invalidate();
+        tileLayers.Invalidate();
+        spriteEngine.Invalidate();
+        scanlineBackground.Invalidate();
+    }
+
+    // Unlike DisableClipping() this takes effect immediately and doesn't start a new frame,
+    // so the palette is still captured by the first command the frame records.
+    void CommandBuffer::ResetClipping()
+    {
+        WaitUntilIdle();
+        Rasterizer::DisableClipping(recordState);
+        Rasterizer::DisableClipping(executeState);
+    }
+
+    void CommandBuffer::SetVideoMode(uint8_t videoMode)
+    {
+        if (videoMode != recordState.videoMode)
+            Rasterizer::SetVideoMode(recordState, videoMode);
+    }
+
+    void CommandBuffer::SetOutputFormat(uint8_t outputFormat)
+    {
+        uint8_t format = outputFormat == OUTPUT_ARGB8888 ? OUTPUT_ARGB8888 : OUTPUT_ABGR8888;
+        if (format == recordState.outputFormat)
+            return;
+
+        WaitUntilIdle();
+        // the palette captured by the frame being recorded is converted already, the formats differ in swapped red and blue
+        if (recordFrame.used != 0)
+            Rasterizer::ConvertPalette(recordFrame.palette, recordFrame.palette, OUTPUT_ARGB8888);
+        recordState.outputFormat = format;
+        executeState.outputFormat = format;
+        recordFrame.scanlineLayer.SetOutputFormat(format);
+        renderFrame.scanlineLayer.SetOutputFormat(format);
+        Invalidate();
+    }
+
+    void CommandBuffer::SetThreadCount(int threadCount)
+    {
+        WaitUntilIdle();
+        if (threadCount != workerPool.GetThreadCount())
+            workerPool.Start(threadCount);
+
+        bandStates.resize(workerPool.GetThreadCount());
+        bandFillBuffers.resize(workerPool.GetThreadCount());
+        tileCaches.resize(workerPool.GetThreadCount());
+        for (std::unique_ptr<TileCache> &tileCache : tileCaches)
+            if (!tileCache)
+                tileCache = std::make_unique<TileCache>(tileMemoryTracker);
+    }
+
+    int CommandBuffer::GetThreadCount()
+    {
+        return workerPool.GetThreadCount();
+    }
+
+    CommandBufferStats CommandBuffer::GetLastFrameStats()
+    {
+        return lastFrameStats;
+    }
+}
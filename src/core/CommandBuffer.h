@@ -0,0 +1,439 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "GPU.h"
+#include "Rasterizer.h"
+#include "TileCache.h"
+#include "TextLayer.h"
+#include "SpriteEngine.h"
+#include "TileLayerCompositor.h"
+#include "ScanlineLayer.h"
+#include "OverlayBackground.h"
+#include "DirtyRegion.h"
+#include "TripleBuffer.h"
+#include "WorkerPool.h"
+
+namespace RetroSim::GPU
+{
+    // Every recorded command starts with this header, followed by the command's argument struct and
+    // for text commands the characters of the string. The size includes the header and is a multiple of 4.
+    struct CommandHeader
+    {
+        uint16_t id; // APICalls
+        // the rectangle the command can draw to, inclusive
+        int16_t left;
+        int16_t top;
+        int16_t right;
+        int16_t bottom;
+        uint16_t reserved;
+        uint32_t size;
+    };
+
+    // The command structs are packed: they are compact in the arena and have no padding bytes,
+    // so two recorded frames can be compared byte by byte.
+#pragma pack(push, 1)
+    struct SetFontCommand
+    {
+        int32_t width;
+        int32_t height;
+        int32_t offset;
+    };
+
+    struct SetPaletteColorCommand
+    {
+        uint32_t color;
+        uint8_t index;
+    };
+
+    struct RenderTextCommand
+    {
+        int32_t x;
+        int32_t y;
+        uint32_t length;
+        uint8_t colorIndex;
+        uint8_t backgroundColorIndex; // only used by RenderOpaqueTextID
+    };
+
+    struct ClearScreenCommand
+    {
+        uint8_t colorIndex;
+    };
+
+    struct DrawPixelCommand
+    {
+        int32_t x;
+        int32_t y;
+        uint8_t colorIndex;
+    };
+
+    struct DrawLineCommand
+    {
+        int32_t x0;
+        int32_t y0;
+        int32_t x1;
+        int32_t y1;
+        uint8_t colorIndex;
+    };
+
+    struct DrawRectCommand
+    {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+        uint8_t colorIndex;
+        bool filled;
+    };
+
+    // A batch of points, vertices or rects, or the vertices of a polygon. The int32 coordinates follow the command.
+    struct DrawBatchCommand
+    {
+        int32_t left; // the bounding box of the batch, inclusive
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+        uint32_t count;
+        uint8_t colorIndex;
+        bool flag;           // closed for polylines, filled for rects
+        uint8_t reserved[2]; // keeps the coordinates 4 byte aligned
+    };
+
+    // The whole clipping rectangle is stored in the header, the fill can reach any part of it.
+    struct FloodFillCommand
+    {
+        int32_t x;
+        int32_t y;
+        uint8_t colorIndex;
+    };
+
+    struct DrawCircleCommand
+    {
+        int32_t x;
+        int32_t y;
+        int32_t radius;
+        uint8_t colorIndex;
+        bool filled;
+    };
+
+    struct DrawTriangleCommand
+    {
+        int32_t x0;
+        int32_t y0;
+        int32_t x1;
+        int32_t y1;
+        int32_t x2;
+        int32_t y2;
+        uint8_t colorIndex;
+        bool filled;
+    };
+
+    // The GPU registers are captured at record time, so later register writes don't affect the command.
+    struct DrawMapCommand
+    {
+        int32_t screenX;
+        int32_t screenY;
+        int32_t mapX;
+        int32_t mapY;
+        int32_t width;
+        int32_t height;
+        int16_t transparentColorIndex;
+        uint8_t tileWidth;
+        uint8_t tileHeight;
+        uint8_t mapWidth;
+    };
+
+    struct DrawSpriteCommand
+    {
+        int32_t x;
+        int32_t y;
+        int32_t spriteX;
+        int32_t spriteY;
+        int32_t width;
+        int32_t height;
+        int16_t transparentColorIndex;
+        uint8_t pitch;
+    };
+
+    struct DrawTransformedSpriteCommand
+    {
+        int32_t x; // the center on the screen
+        int32_t y;
+        int32_t spriteX;
+        int32_t spriteY;
+        int32_t width;
+        int32_t height;
+        int32_t matrix[4]; // the screen to atlas transformation, see Rasterizer::DrawTransformedSprite()
+        int32_t left;      // the bounding box on the screen, inclusive
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+        int16_t transparentColorIndex;
+        uint8_t pitch;
+    };
+
+    struct DrawBitmapCommand
+    {
+        int32_t screenPosX;
+        int32_t screenPosY;
+        int32_t bitmapPosX;
+        int32_t bitmapPosY;
+        int32_t width;
+        int32_t height;
+        int32_t pitch;
+        int16_t transparentColorIndex;
+    };
+
+    struct SetClippingCommand
+    {
+        int32_t x0;
+        int32_t y0;
+        int32_t x1;
+        int32_t y1;
+    };
+
+    struct DisableClippingCommand
+    {
+        uint8_t reserved;
+    };
+
+    struct SetBlendModeCommand
+    {
+        uint8_t mode;
+    };
+
+    struct SetStencilModeCommand
+    {
+        uint8_t mode;
+    };
+
+    struct ClearStencilCommand
+    {
+        bool value;
+    };
+
+    // The destination rectangle of a copy is clipped at record time and stored in the command's header.
+    struct CopyRectCommand
+    {
+        int32_t srcX;
+        int32_t srcY;
+        int32_t width;
+        int32_t height;
+        int32_t dstX;
+        int32_t dstY;
+    };
+
+    struct ScrollCommand
+    {
+        int32_t dx;
+        int32_t dy;
+    };
+
+    // Followed by a bit for every row of the guest framebuffer, set for the rows that changed, then in the indexed modes
+    // the 256 colors of the palette, then the pixels of those rows.
+    struct DrawFramebufferCommand
+    {
+        uint16_t firstRow; // the first and the last changed row
+        uint16_t lastRow;
+    };
+
+    struct DrawSpriteLayerCommand
+    {
+        uint8_t atlasPitch;
+    };
+
+    struct DrawScanlineLayerCommand
+    {
+        uint8_t reserved;
+    };
+
+    // The tile layers' registers are read from the memory snapshot.
+    struct DrawTileLayersCommand
+    {
+        bool readsBitmap; // an affine layer samples BITMAP_U8
+    };
+
+    // The text layer's registers, its cells are read from the memory snapshot.
+    struct DrawTextLayerCommand
+    {
+        uint8_t fontHeight;
+        uint8_t backgroundColorIndex;
+    };
+#pragma pack(pop)
+
+    struct CommandBufferStats
+    {
+        uint32_t commandCount = 0;             // commands recorded in the frame
+        uint32_t culledCommandCount = 0;       // commands dropped at record time because they were fully clipped
+        uint32_t bytesRecorded = 0;            // arena bytes used by the frame
+        bool identicalToPreviousFrame = false; // the previous output was kept instead of rendering the frame again
+    };
+
+    // The memory sections read by the commands of a frame, these are copied when the frame is submitted.
+    enum MemoryReference
+    {
+        REFERENCES_MAP = 1,
+        REFERENCES_SPRITE_ATLAS = 2,
+        REFERENCES_BITMAP = 4,
+        REFERENCES_CHARSET = 8,
+        REFERENCES_TILES = 16,
+        REFERENCES_TEXT = 32,
+        REFERENCES_SPRITE_ATTRIBUTES = 64,
+        REFERENCES_TILE_LAYERS = 128,
+    };
+
+    // Records the GPU API calls of a frame into a linear arena. At the end of the frame the arena is handed to the
+    // render thread together with a snapshot of the memory the commands read, so the next frame can run on the CPU
+    // while this one is rasterized. The arenas are reused, recording doesn't allocate in steady state.
+    class CommandBuffer
+    {
+    public:
+        CommandBuffer();
+        ~CommandBuffer();
+
+        template <typename T>
+        void Record(APICalls id, const T &command, std::string_view text = {})
+        {
+            CommandHeader header = {(uint16_t)id};
+            if (IsCulled(id, &command, header))
+            {
+                recordFrame.stats.culledCommandCount++;
+                return;
+            }
+
+            TrackState(id, &command, header);
+
+            uint32_t size = AlignSize(sizeof(CommandHeader) + sizeof(T) + (uint32_t)text.size());
+            uint8_t *destination = Allocate(size);
+
+            header.size = size;
+            memset(destination + size - 4, 0, 4); // alignment bytes at the end
+            memcpy(destination, &header, sizeof(CommandHeader));
+            memcpy(destination + sizeof(CommandHeader), &command, sizeof(T));
+            if (!text.empty())
+                memcpy(destination + sizeof(CommandHeader) + sizeof(T), text.data(), text.size());
+
+            recordFrame.stats.commandCount++;
+        }
+
+        // Hands the recorded frame to the render thread, which draws it on top of the last frame published
+        // in output and publishes the result. Frames identical to the previous one aren't published.
+        void Submit(TripleBuffer &output);
+        // Waits until the submitted frame is rasterized.
+        void WaitForFrame();
+
+        void Invalidate();
+        void ResetClipping();
+        // The video mode of the frames recorded from now on, switching resets the clipping rectangle.
+        void SetVideoMode(uint8_t videoMode);
+        void SetOutputFormat(uint8_t outputFormat);
+        void SetThreadCount(int threadCount);
+        int GetThreadCount();
+        CommandBufferStats GetLastFrameStats();
+        // the lines composed for the frame being recorded in scanline mode
+        ScanlineLayer &GetScanlineLayer() { return recordFrame.scanlineLayer; }
+
+    private:
+        // Everything the render thread needs to rasterize a frame. It is immutable once submitted.
+        struct Frame
+        {
+            std::vector<uint8_t> arena;
+            uint32_t used = 0;
+            uint32_t palette[256] = {};
+            uint32_t memoryReferences = 0;
+            uint32_t paletteCommandCount = 0;
+            bool readsTarget = false;  // a command blends with or copies existing pixels or tests the stencil, so drawing the frame twice differs from drawing it once
+            uint32_t frameCommandCount = 0; // commands that read or write the rows of other bands, they run on the whole frame
+            DrawTextLayerCommand textLayer = {}; // valid if the frame references the text memory
+            uint8_t videoMode = VIDEO_MODE_464X256;
+            ScanlineLayer scanlineLayer;
+            // copy of the referenced memory sections, at their MMU addresses
+            std::vector<uint8_t> memory;
+            DirtyRegion dirtyRegion;
+            CommandBufferStats stats;
+        };
+
+        // owned by the CPU thread
+        Frame recordFrame;
+        // render state as seen by the recorder, used for culling
+        Rasterizer::RenderState recordState;
+        CommandBufferStats lastFrameStats;
+        uint8_t submittedVideoMode = VIDEO_MODE_464X256;
+
+        // owned by the render thread while a frame is pending
+        Frame renderFrame;
+        TripleBuffer *output = nullptr;
+        uint32_t *renderTarget = nullptr;
+        const uint32_t *previousOutput = nullptr;
+        bool startsCleared = false; // the video mode changed, the frame isn't drawn on top of the previous output
+        bool resultPending = false; // a submitted frame that WaitForFrame() hasn't collected yet
+        // render state as seen by the rasterizers, persists across frames
+        Rasterizer::RenderState executeState;
+        // the state of every band while the frame is rendered
+        std::vector<Rasterizer::RenderState> bandStates;
+        // scratch memory of the fills, for every band and for the commands that run on the whole frame
+        std::vector<Rasterizer::FillBuffers> bandFillBuffers;
+        Rasterizer::FillBuffers frameFillBuffers;
+        // the stencil bits of the frame buffer, persist across frames
+        std::vector<uint64_t> stencil;
+        Rasterizer::RenderState previousStartState;
+        std::vector<uint8_t> previousArena;
+        uint32_t previousUsed = 0;
+        uint32_t previousPalette[256];
+        uint64_t previousMemoryHash = 0;
+        bool previousFrameValid = false;
+
+        // every thread renders its own horizontal band of the frame, with its own tile cache
+        WorkerPool workerPool;
+        TileMemoryTracker tileMemoryTracker;
+        std::vector<std::unique_ptr<TileCache>> tileCaches;
+        // palette versions for the tile cache, see RenderState::paletteVersion
+        uint32_t versionedPalette[256] = {};
+        uint64_t framePaletteVersion = 0;
+        uint64_t firstCommandPaletteVersion = 1;
+        uint64_t nextPaletteVersion = 1;
+        // which cells of the text layer the frame has to draw
+        TextLayer textLayer;
+        // the enabled tile layers, front to back
+        TileLayerCompositor tileLayers;
+        // the sprites of the attribute table, sorted by scanline
+        SpriteEngine spriteEngine;
+        // the pixels under the lines composed in scanline mode
+        OverlayBackground scanlineBackground;
+
+        std::thread renderThread;
+        std::mutex mutex;
+        std::condition_variable frameSubmitted;
+        std::condition_variable frameFinished;
+        bool framePending = false;
+        bool stopping = false;
+
+        static uint32_t AlignSize(uint32_t size) { return (size + 3) & ~3u; }
+        uint8_t *Allocate(uint32_t size);
+        static bool IsStateCommand(uint16_t id);
+        bool IsCulled(APICalls id, const void *command, CommandHeader &header);
+        void TrackState(APICalls id, const void *command, const CommandHeader &header);
+        void TakeMemorySnapshot(Frame &frame);
+        uint64_t HashReferencedMemory(const Frame &frame);
+        void RenderLoop();
+        void Execute();
+        void ExecuteCommand(Rasterizer::RenderState &state, const CommandHeader *header);
+        static bool IsFrameCommand(const CommandHeader *header);
+        uint32_t FindFrameCommand(uint32_t offset);
+        void BeginBand(int band, int y0, int y1);
+        void ExecuteBand(int band, uint32_t begin, uint32_t end);
+        void UpdateTileCacheState();
+        void ApplyStateChanges(Rasterizer::RenderState &state);
+        void WaitUntilIdle();
+    };
+
+    extern CommandBuffer commandBuffer;
+}
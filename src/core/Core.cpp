@@ -204,30 +204,41 @@ namespace RetroSim
         }
     }
 
-    void Core::InitializeFonts()
+    // Packs a font stored as one value per pixel into 1bpp rows, leftmost pixel in the most significant bit.
+    // Returns the number of bytes written.
+    size_t PackFont(const int *pixels, int length, int width, uint8_t *destination, size_t capacity)
     {
-        size_t length = std::min(unscii_16_length, 0x8000);
-        for (int i = 0; i < length; i++)
-        {
-            MMU::memory.Charset_u8[i] = unscii_16[i];
-        }
+        int rowSize = (width + 7) / 8;
+        size_t rowCount = std::min((size_t)(length / width), capacity / rowSize);
 
-        length = std::min(unscii_8_length, 0x8000);
-        for (int i = 0; i < length; i++)
+        memset(destination, 0, rowCount * rowSize);
+        for (size_t row = 0; row < rowCount; row++)
         {
-            MMU::memory.Charset_u8[i + 0x8000] = unscii_8[i];
+            for (int x = 0; x < width; x++)
+            {
+                if (pixels[row * width + x] != 0)
+                    destination[row * rowSize + x / 8] |= 0x80 >> (x % 8);
+            }
         }
 
-        // copy first 16K from character ram to tile ram
+        return rowCount * rowSize;
+    }
+
+    void Core::InitializeFonts()
+    {
+        // the fonts are packed to 1bpp, 8x16 at offset 0 and 8x8 at offset $8000 (see GPU::SetFont)
+        size_t length16 = PackFont(unscii_16, unscii_16_length, 8, MMU::memory.Charset_u8, 0x8000);
+        size_t length8 = PackFont(unscii_8, unscii_8_length, 8, MMU::memory.Charset_u8 + 0x8000, 0x8000);
+
+        // copy the first 16K of unscii_16 to tile ram, the tiles are one byte per pixel
         for (int i = 0; i < 0x4000; i++)
         {
-            uint8_t value = MMU::memory.Charset_u8[i];
-            MMU::memory.Tiles_u8[i] = value;
+            MMU::memory.Tiles_u8[i] = unscii_16[i];
         }
 
-        LogPrintf(RETRO_LOG_INFO, "Copied $%x bytes from unscii_16 to $%x-$%x\n", length, MMU::CHARSET_U8, MMU::CHARSET_U8 + length);
-        LogPrintf(RETRO_LOG_INFO, "Copied $%x bytes from unscii_8 to $%x-$%x\n", length, MMU::CHARSET_U8 + 0x8000, MMU::CHARSET_U8 + 0x8000 + length);
-        LogPrintf(RETRO_LOG_INFO, "Copied $%x bytes from $%x to $%x-$%x\n", 0x4000, MMU::CHARSET_U8, MMU::TILES_U8, MMU::TILES_U8 + 0x4000);
+        LogPrintf(RETRO_LOG_INFO, "Packed unscii_16 into $%x bytes at $%x-$%x\n", length16, MMU::CHARSET_U8, MMU::CHARSET_U8 + length16);
+        LogPrintf(RETRO_LOG_INFO, "Packed unscii_8 into $%x bytes at $%x-$%x\n", length8, MMU::CHARSET_U8 + 0x8000, MMU::CHARSET_U8 + 0x8000 + length8);
+        LogPrintf(RETRO_LOG_INFO, "Copied $%x bytes from unscii_16 to $%x-$%x\n", 0x4000, MMU::TILES_U8, MMU::TILES_U8 + 0x4000);
     }
 
     void Core::InitializeCPU()
@@ -315,6 +326,38 @@ namespace RetroSim
 #endif
     }
 
+    // The frame's CPU cycles are split evenly between the lines of the screen. After the CPU ran a line the GPU
+    // composes it, so changes the CPU makes in the middle of the frame (e.g. from the raster IRQ) affect only the
+    // lines below. The raster IRQ is raised before the CPU runs the line in rasterIrqLine.
+    void Core::RunScanlines()
+    {
+        // the screen of the frame's video mode, the GPU sets the register when the mode changes
+        int lineCount = std::clamp((int)MMU::memory.gpu.screenHeight, 1, (int)GPU::textureHeight);
+        int cyclesPerLine = std::max(coreConfig.cpuCyclesPerFrame / lineCount, 1);
+        int cycles = 0;
+        int lineEnd = 0;
+
+        for (int line = 0; line < lineCount; line++)
+        {
+            MMU::memory.gpu.currentScanline = (uint16_t)line;
+
+            if (MMU::memory.gpu.rasterIrqEnabled != 0 && MMU::memory.gpu.rasterIrqLine == line)
+                cpu.InterruptRaised();
+
+            // instructions running over the end of a line are taken from the next one
+            lineEnd += cyclesPerLine;
+            if (cpu.sleep == false)
+            {
+                while (cycles < lineEnd)
+                    cycles += cpu.Tick();
+            }
+            else
+                cycles = std::max(cycles, lineEnd);
+
+            GPU::RenderScanline(line);
+        }
+    }
+
     void Core::RunNextFrame()
     {
         uint32_t cpuBefore = GetTicks();
@@ -322,19 +365,30 @@ namespace RetroSim
             if (scriptingEnabled)
                 GravityScripting::RunScript("update", {}, 0);
 
-            // std::lock_guard<std::mutex> lock(memoryMutex);
             // DrawTestScreen();
         }
 
-        int cycles = 0;
-
-        if (cpu.sleep == false)
+        if (MMU::memory.gpu.scanlineMode != 0)
+        {
+            RunScanlines();
+        }
+        else
         {
-            while (cycles < coreConfig.cpuCyclesPerFrame)
+            int cycles = 0;
+
+            if (cpu.sleep == false)
             {
-                cycles += cpu.Tick();
+                while (cycles < coreConfig.cpuCyclesPerFrame)
+                {
+                    cycles += cpu.Tick();
+                }
             }
         }
+
+        // The render thread works on a copy of the memory the frame reads, so the next frame
+        // can modify the memory while this one is drawn without any locking.
+        GPU::RenderFrame();
+
         uint32_t cpuAfter = GetTicks();
         int timeDelta = cpuAfter - cpuBefore;
         clock += timeDelta;
@@ -427,7 +481,23 @@ namespace RetroSim
 
     void Core::SyscallHandler(uint16_t syscallID, uint32_t argumentAddress)
     {
-        LogPrintf(RETRO_LOG_DEBUG, "Syscall %d, argument struct address: %8x\n", syscallID, argumentAddress);
+        auto argument = [argumentAddress](int index)
+        {
+            return (int)MMU::ReadMem<int16_t>(argumentAddress + index * sizeof(int16_t));
+        };
+
+        switch (syscallID)
+        {
+        case SYSCALL_GPU_COPY_RECT:
+            GPU::CopyRect(argument(0), argument(1), argument(2), argument(3), argument(4), argument(5));
+            break;
+        case SYSCALL_GPU_SCROLL:
+            GPU::Scroll(argument(0), argument(1));
+            break;
+        default:
+            LogPrintf(RETRO_LOG_DEBUG, "Syscall %d, argument struct address: %8x\n", syscallID, argumentAddress);
+            break;
+        }
     }
 
     void Core::RenderAudio(uint16_t **audioBuffer, uint32_t *audioBufferSize)
@@ -14,6 +14,13 @@ class CoreImGui;
 
 namespace RetroSim
 {
+    // The IDs of the CPU's "sys id, address" instruction. The arguments are read from a struct of 16 bit values at the address.
+    enum Syscalls
+    {
+        SYSCALL_GPU_COPY_RECT = 1, // srcX, srcY, width, height, dstX, dstY
+        SYSCALL_GPU_SCROLL = 2,    // dx, dy
+    };
+
     class Core
     {
     public:
@@ -59,6 +66,7 @@ namespace RetroSim
         void InitializePalette();
         void InitializeCPU();
         void UpdateRegisters();
+        void RunScanlines();
         static void SyscallHandler(uint16_t syscallID, uint32_t argumentAddress);
     };
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <sstream>
 #include <fstream>
 #include <regex>
+#include <thread>
+#include <algorithm>
 #include "CoreConfig.h"
 #include "FileUtils.h"
 #include "Logger.h"
@@ -68,6 +70,31 @@ namespace RetroSim
         return audioSampleRate;
     }
 
+    int CoreConfig::GetRenderThreads()
+    {
+        if (renderThreads > 0)
+            return renderThreads;
+
+        // beyond a few threads the bands get too thin to be worth it
+        int hardwareThreads = (int)std::thread::hardware_concurrency();
+        return std::clamp(hardwareThreads, 1, 8);
+    }
+
+    bool CoreConfig::IsRGB565Output()
+    {
+        return rgb565Output;
+    }
+
+    int CoreConfig::GetCrtFilterScale()
+    {
+        return crtFilterScale;
+    }
+
+    bool CoreConfig::IsSoftwareScaling()
+    {
+        return softwareScaling;
+    }
+
     void CoreConfig::LoadConfigFile()
     {
         const std::string fileName = basePath + "/retrosim.config";
@@ -132,6 +159,26 @@ namespace RetroSim
                         cpuCyclesPerFrame = stoi(value);
                         LogPrintf(RETRO_LOG_INFO, "CPU cycles per frame: %d\n", cpuCyclesPerFrame);
                     }
+                    else if (key == "renderThreads")
+                    {
+                        renderThreads = stoi(value);
+                        LogPrintf(RETRO_LOG_INFO, "Render threads: %d\n", renderThreads);
+                    }
+                    else if (key == "rgb565Output")
+                    {
+                        rgb565Output = (value == "true");
+                        LogPrintf(RETRO_LOG_INFO, "RGB565 output: %s\n", rgb565Output ? "true" : "false");
+                    }
+                    else if (key == "crtFilterScale")
+                    {
+                        crtFilterScale = std::clamp(stoi(value), 0, 8);
+                        LogPrintf(RETRO_LOG_INFO, "CRT filter scale: %d\n", crtFilterScale);
+                    }
+                    else if (key == "softwareScaling")
+                    {
+                        softwareScaling = (value == "true");
+                        LogPrintf(RETRO_LOG_INFO, "Software scaling: %s\n", softwareScaling ? "true" : "false");
+                    }
                     else
                     {
                         LogPrintf(RETRO_LOG_WARN, "Unknown key in config file: %s\n", key.c_str());
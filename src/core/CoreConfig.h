@@ -19,6 +19,10 @@ namespace RetroSim
         void SetTargetFPS(int fps);
         int GetWindowScale();
         int GetAudioSampleRate();
+        int GetRenderThreads();
+        bool IsRGB565Output();
+        int GetCrtFilterScale();
+        bool IsSoftwareScaling();
         int cpuCyclesPerFrame = 32768;// How many CPU cycles we want to execute per frame.
 
     private:
@@ -30,6 +34,10 @@ namespace RetroSim
         int targetFps = 60;          // The current fps. Set to the current freq. of the monitor.
         int audioSampleRate = 48000; // The audio engine will output samples on this frequency.
         int windowScale = 1;         // The window will be scaled by this factor.
+        int renderThreads = 0;       // Number of threads rasterizing the frame. 0 picks it based on the CPU.
+        bool rgb565Output = false;   // The libretro core sends 16-bit frames if the frontend supports them.
+        int crtFilterScale = 0;      // The libretro core applies the CRT filter in software and scales its frames by this. 0 turns it off.
+        bool softwareScaling = false; // The SDL frontend scales the frames up on the CPU instead of the renderer.
 
         bool isInitialized = false;
 
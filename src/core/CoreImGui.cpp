@@ -4,6 +4,7 @@
 #include "imgui.h"
 #include "imfilebrowser.h"
 #include "GravityScripting.h"
+#include "CommandBuffer.h"
 
 namespace RetroSim
 {
@@ -97,6 +98,13 @@ namespace RetroSim
             ImGui::Text("Map Width: %d", MMU::memory.gpu.mapWidth);
             ImGui::Text("Map Height: %d", MMU::memory.gpu.mapHeight);
             ImGui::Text("Sprite Atlas Pitch: %d", MMU::memory.gpu.spriteAtlasPitch);
+
+            GPU::CommandBufferStats stats = GPU::commandBuffer.GetLastFrameStats();
+            ImGui::Text("Commands per frame: %u", stats.commandCount);
+            ImGui::Text("Culled commands: %u", stats.culledCommandCount);
+            ImGui::Text("Bytes recorded: %u", stats.bytesRecorded);
+            ImGui::Text("Identical to previous frame: %s", stats.identicalToPreviousFrame ? "Yes" : "No");
+            ImGui::Text("Render threads: %d", GPU::commandBuffer.GetThreadCount());
         }
 
         if (ImGui::CollapsingHeader("A65000 CPU", openHeader))
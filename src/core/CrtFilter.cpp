@@ -0,0 +1,412 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include "CrtFilter.h"
+#include "Simd.h"
+
+namespace RetroSim::GPU
+{
+    namespace
+    {
+        const int maxOutputSize = 4096;  // the coordinates of the warp table have 12 bits
+        const float scanlineThin = 0.5f; // INPUT_THIN of the shader, SCANLINE_THINNESS isn't a parameter here
+
+        // Everything one output row is finished with: the colors are combined from two filtered rows, masked,
+        // tone mapped, shaded by the scanline term and converted back to sRGB.
+        struct RowFinish
+        {
+            const float *colorA;
+            const float *colorB;
+            float weightA, weightB;
+            const float *mask[3];
+            float shade;
+            float toneScale, toneBias;
+            const uint32_t *toSrgb;
+            float maxLevel; // the last index of toSrgb
+            int width;
+            int redShift, blueShift;
+            uint32_t *destination;
+        };
+
+        inline float Saturate(float value)
+        {
+            return std::clamp(value, 0.0f, 1.0f);
+        }
+
+        void FinishRowScalar(const RowFinish &row, int x)
+        {
+            const float minimumPeak = 1.0f / (256.0f * 65536.0f);
+            int width = row.width;
+            for (; x < width; x++)
+            {
+                float color[3];
+                for (int c = 0; c < 3; c++)
+                    color[c] = (row.colorA[c * width + x] * row.weightA + row.colorB[c * width + x] * row.weightB) * row.mask[c][x];
+
+                float peak = std::max(std::max(color[0], color[1]), std::max(color[2], minimumPeak));
+                float factor = row.shade / (peak * row.toneScale + row.toneBias);
+                uint32_t level[3];
+                for (int c = 0; c < 3; c++)
+                    level[c] = row.toSrgb[(int)(std::min(std::max(color[c] * factor, 0.0f), 1.0f) * row.maxLevel + 0.5f)];
+
+                row.destination[x] = 0xFF000000 | (level[0] << row.redShift) | (level[1] << 8) | (level[2] << row.blueShift);
+            }
+        }
+
+#ifdef RETROSIM_AVX2
+        // The same in eight pixels at a time, the sRGB table is read with gathers.
+        RETROSIM_AVX2_FUNCTION void FinishRowAVX2(const RowFinish &row)
+        {
+            const __m256 levels = _mm256_set1_ps(row.maxLevel);
+            const __m256 minimumPeak = _mm256_set1_ps(1.0f / (256.0f * 65536.0f));
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 half = _mm256_set1_ps(0.5f);
+            const __m256 weightA = _mm256_set1_ps(row.weightA);
+            const __m256 weightB = _mm256_set1_ps(row.weightB);
+            const __m256 shade = _mm256_set1_ps(row.shade);
+            const __m256 toneScale = _mm256_set1_ps(row.toneScale);
+            const __m256 toneBias = _mm256_set1_ps(row.toneBias);
+            const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+            const __m128i redShift = _mm_cvtsi32_si128(row.redShift);
+            const __m128i blueShift = _mm_cvtsi32_si128(row.blueShift);
+            const int *toSrgb = (const int *)row.toSrgb;
+
+            int width = row.width;
+            int x = 0;
+            for (; x + 8 <= width; x += 8)
+            {
+                __m256 color[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(row.colorA + c * width + x), weightA);
+                    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(row.colorB + c * width + x), weightB);
+                    color[c] = _mm256_mul_ps(_mm256_add_ps(a, b), _mm256_loadu_ps(row.mask[c] + x));
+                }
+
+                __m256 peak = _mm256_max_ps(_mm256_max_ps(color[0], color[1]), _mm256_max_ps(color[2], minimumPeak));
+                __m256 factor = _mm256_div_ps(shade, _mm256_add_ps(_mm256_mul_ps(peak, toneScale), toneBias));
+                __m256i level[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(color[c], factor), zero), one);
+                    __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, levels), half));
+                    level[c] = _mm256_i32gather_epi32(toSrgb, index, 4);
+                }
+
+                __m256i pixel = _mm256_or_si256(alpha, _mm256_slli_epi32(level[1], 8));
+                pixel = _mm256_or_si256(pixel, _mm256_sll_epi32(level[0], redShift));
+                pixel = _mm256_or_si256(pixel, _mm256_sll_epi32(level[2], blueShift));
+                _mm256_storeu_si256((__m256i *)(row.destination + x), pixel);
+            }
+
+            FinishRowScalar(row, x);
+        }
+#endif
+    }
+
+    void CrtFilter::SetThreadCount(int threadCount)
+    {
+        if (threadCount != workerPool.GetThreadCount())
+            workerPool.Start(threadCount);
+    }
+
+    void CrtFilter::Apply(const Source &source, int scale, const MMU::ShaderParameters &parameters, uint32_t *destination, int destinationPitch, bool swapRedBlue)
+    {
+        scale = std::clamp(scale, 1, std::max(1, std::min(maxOutputSize / source.width, maxOutputSize / source.height)));
+        if (!IsTableCurrent(source, scale, parameters))
+            BuildTables(source, scale, parameters);
+
+        int outputWidth = source.width * scale;
+        int outputHeight = source.height * scale;
+        int bandCount = workerPool.GetThreadCount();
+        bool warp = !warpTable.empty();
+
+        bands.resize(bandCount);
+        for (Band &band : bands)
+        {
+            band.linear.resize(3 * (source.width + 2 * columnPadding));
+            band.rows[0].resize(3 * outputWidth);
+            band.rows[1].resize(3 * outputWidth);
+            band.rowIndex[0] = band.rowIndex[1] = INT_MIN;
+        }
+
+        if (!warp)
+        {
+            workerPool.Run([&](int bandIndex)
+            {
+                Band &band = bands[bandIndex];
+                int top = outputHeight * bandIndex / bandCount;
+                int bottom = outputHeight * (bandIndex + 1) / bandCount;
+                for (int y = top; y < bottom; y++)
+                {
+                    const float *rowA = GetFilteredRow(band, source, rowStart[y]);
+                    const float *rowB = GetFilteredRow(band, source, rowStart[y] + 1);
+                    FinishRow(rowA, rowB, rowWeights[0][y], rowWeights[1][y], y, destination + (size_t)y * destinationPitch, swapRedBlue);
+                }
+            });
+            return;
+        }
+
+        // With curvature the output rows don't follow the scanlines, every source row is filtered first, with the
+        // channels of a pixel next to each other for the gathers. The rows go from -1 to height, around the image.
+        int filteredRowCount = source.height + 2;
+        workerPool.Run([&](int bandIndex)
+        {
+            Band &band = bands[bandIndex];
+            int first = filteredRowCount * bandIndex / bandCount;
+            int last = filteredRowCount * (bandIndex + 1) / bandCount;
+            for (int row = first; row < last; row++)
+            {
+                const float *filtered = GetFilteredRow(band, source, row - 1);
+                float *target = filteredRows.data() + (size_t)row * outputWidth * 3;
+                for (int x = 0; x < outputWidth; x++)
+                    for (int c = 0; c < 3; c++)
+                        target[x * 3 + c] = filtered[c * outputWidth + x];
+            }
+        });
+
+        workerPool.Run([&](int bandIndex)
+        {
+            float *curved = bands[bandIndex].rows[0].data();
+            int top = outputHeight * bandIndex / bandCount;
+            int bottom = outputHeight * (bandIndex + 1) / bandCount;
+            for (int y = top; y < bottom; y++)
+            {
+                const uint32_t *warpRow = warpTable.data() + (size_t)y * outputWidth;
+                for (int x = 0; x < outputWidth; x++)
+                {
+                    uint32_t entry = warpRow[x];
+                    int sourceX = entry & 0xFFF;
+                    int sourceY = (entry >> 12) & 0xFFF;
+                    float brightness = (float)(entry >> 24) * (1.0f / 255.0f);
+                    float weightA = rowWeights[0][sourceY] * brightness;
+                    float weightB = rowWeights[1][sourceY] * brightness;
+                    const float *a = filteredRows.data() + ((size_t)(rowStart[sourceY] + 1) * outputWidth + sourceX) * 3;
+                    const float *b = a + (size_t)outputWidth * 3;
+                    for (int c = 0; c < 3; c++)
+                        curved[c * outputWidth + x] = a[c] * weightA + b[c] * weightB;
+                }
+
+                FinishRow(curved, curved, 1.0f, 0.0f, y, destination + (size_t)y * destinationPitch, swapRedBlue);
+            }
+        });
+    }
+
+    bool CrtFilter::IsTableCurrent(const Source &source, int scale, const MMU::ShaderParameters &parameters) const
+    {
+        return tableScale == scale && tableWidth == source.width && tableHeight == source.height &&
+               std::memcmp(&tableParameters, &parameters, sizeof(parameters)) == 0;
+    }
+
+    void CrtFilter::BuildTables(const Source &source, int scale, const MMU::ShaderParameters &parameters)
+    {
+        tableParameters = parameters;
+        tableWidth = source.width;
+        tableHeight = source.height;
+        tableScale = scale;
+
+        int outputWidth = source.width * scale;
+        int outputHeight = source.height * scale;
+
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow(c / 1.055f + 0.055f / 1.055f, parameters.CRT_GAMMA);
+        }
+        for (int i = 0; i < linearLevels; i++)
+        {
+            float c = (float)i / (linearLevels - 1);
+            float srgb = c < 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 0.41666f) - 0.055f;
+            toSrgb[i] = (uint32_t)std::lround(Saturate(srgb) * 255.0f);
+        }
+
+        // the four horizontal taps, weighted by a gaussian with the sharpness of SCAN_BLUR
+        float blur = -parameters.SCAN_BLUR;
+        columnStart.resize(outputWidth);
+        for (std::vector<float> &weights : columnWeights)
+            weights.resize(outputWidth);
+        for (int x = 0; x < outputWidth; x++)
+        {
+            float position = (x + 0.5f) / scale;
+            float first = std::floor(position - 1.5f);
+            float offset = position - (first + 0.5f);
+            float weights[4];
+            float total = 0.0f;
+            for (int i = 0; i < 4; i++)
+            {
+                weights[i] = std::exp2(blur * (offset - i) * (offset - i));
+                total += weights[i];
+            }
+
+            columnStart[x] = (int32_t)first + columnPadding;
+            for (int i = 0; i < 4; i++)
+                columnWeights[i][x] = weights[i] / total;
+        }
+
+        // the two scanlines around each output row, and the extra shading the shaders apply per output row
+        const float pi = 3.14159265f;
+        float strength = parameters.SCANLINE_STRENGTH;
+        rowStart.resize(outputHeight);
+        rowWeights[0].resize(outputHeight);
+        rowWeights[1].resize(outputHeight);
+        rowShade.resize(outputHeight);
+        for (int y = 0; y < outputHeight; y++)
+        {
+            float position = (y + 0.5f) / scale;
+            float first = std::floor(position - 0.5f);
+            float offset = position - (first + 0.5f);
+            rowStart[y] = (int32_t)first;
+            rowWeights[0][y] = std::cos(std::min(0.5f, offset * scanlineThin) * 2.0f * pi) * 0.5f + 0.5f;
+            rowWeights[1][y] = std::cos(std::min(0.5f, (1.0f - offset) * scanlineThin) * 2.0f * pi) * 0.5f + 0.5f;
+
+            // gl_FragCoord counts from the bottom
+            float normalizedY = (outputHeight - y - 0.5f) / outputHeight;
+            rowShade[y] = 1.0f + strength / 5.0f - std::pow(std::sin(source.height * normalizedY * pi + pi / 2), 16.0f) * strength;
+        }
+
+        // the phosphor mask: 1 aperture grille, 2 its subtractive variant, 3 shadow mask, otherwise none
+        int maskType = (int)parameters.MASK;
+        float dark = 1.0f - parameters.MASK_INTENSITY;
+        maskRows = maskType == 3 ? 2 : 1;
+        for (int row = 0; row < 2; row++)
+        {
+            for (int c = 0; c < 3; c++)
+                mask[row][c].assign(outputWidth, 1.0f);
+
+            if (maskType < 1 || maskType > 3)
+                continue;
+
+            for (int x = 0; x < outputWidth; x++)
+            {
+                // the shadow mask is shifted by half a triad in every other row
+                int channel = maskType == 3 ? ((x + 3 * row + 1) % 6) / 2 : x % 3;
+                for (int c = 0; c < 3; c++)
+                {
+                    if (maskType == 1)
+                        mask[row][c][x] = c == channel ? dark : 1.0f;
+                    else
+                        mask[row][c][x] = c == channel ? 1.0f : dark;
+                }
+            }
+        }
+
+        // the tone mapping that brings the mid level back after the mask and the scanlines darkened it
+        float toneMask = maskType == 0 ? 1.0f : maskType == 1 ? 0.5f + dark * 0.5f : dark;
+        float midOut = 0.18f / ((1.5f - scanlineThin) * (0.5f * toneMask + 0.5f));
+        float midIn = 0.18f;
+        toneScale = (midOut - midIn) / ((1.0f - midIn) * midOut);
+        toneBias = (-midIn * midOut + midIn) / (midOut * -midIn + midOut);
+
+        warpTable.clear();
+        filteredRows.clear();
+        if (parameters.CURVATURE != 0.0f)
+            BuildWarpTable(parameters, outputWidth, outputHeight);
+    }
+
+    void CrtFilter::BuildWarpTable(const MMU::ShaderParameters &parameters, int outputWidth, int outputHeight)
+    {
+        // assumes 4:3 like the shaders
+        float warpX = parameters.CURVATURE * (1.0f - parameters.TRINITRON_CURVE);
+        float warpY = 0.75f * parameters.CURVATURE;
+        float corner = 0.998f + 0.001f * parameters.CORNER;
+        float inputHeight = (float)tableHeight;
+
+        warpTable.resize((size_t)outputWidth * outputHeight);
+        filteredRows.resize((size_t)(tableHeight + 2) * outputWidth * 3);
+
+        for (int y = 0; y < outputHeight; y++)
+        {
+            for (int x = 0; x < outputWidth; x++)
+            {
+                float px = (x + 0.5f) * 2.0f / outputWidth - 1.0f;
+                float py = (y + 0.5f) * 2.0f / outputHeight - 1.0f;
+                float warpedX = px * (1.0f + py * py * warpX);
+                float warpedY = py * (1.0f + px * px * warpY);
+
+                float vignette = (1.0f - (1.0f - Saturate(warpedX * warpedX)) * (1.0f - Saturate(warpedY * warpedY))) * corner;
+                vignette = Saturate(-vignette * inputHeight + inputHeight);
+
+                int sourceX = (int)std::floor((warpedX * 0.5f + 0.5f) * outputWidth);
+                int sourceY = (int)std::floor((warpedY * 0.5f + 0.5f) * outputHeight);
+                uint32_t brightness = (uint32_t)std::lround(vignette * 255.0f);
+                if (sourceX < 0 || sourceX >= outputWidth || sourceY < 0 || sourceY >= outputHeight)
+                    brightness = 0;
+
+                uint32_t position = brightness != 0 ? (uint32_t)(sourceY << 12 | sourceX) : 0;
+                warpTable[(size_t)y * outputWidth + x] = (brightness << 24) | position;
+            }
+        }
+    }
+
+    // Returns the source row filtered horizontally, from the band's cache when the previous output row used it too.
+    // Consecutive rows alternate between the two slots, so the two rows of an output row never evict each other.
+    const float *CrtFilter::GetFilteredRow(Band &band, const Source &source, int row) const
+    {
+        int slot = row & 1;
+        float *filtered = band.rows[slot].data();
+        if (band.rowIndex[slot] == row)
+            return filtered;
+        band.rowIndex[slot] = row;
+
+        int outputWidth = source.width * tableScale;
+        int screenRow = row - source.y;
+        if (screenRow < 0 || screenRow >= source.screenHeight)
+        {
+            std::fill_n(filtered, 3 * outputWidth, 0.0f);
+            return filtered;
+        }
+
+        // the row in linear light, with black around the screen
+        int paddedWidth = source.width + 2 * columnPadding;
+        float *linear = band.linear.data();
+        std::fill_n(linear, 3 * paddedWidth, 0.0f);
+        const uint32_t *pixel = source.pixels + (size_t)screenRow * source.pitch;
+        for (int x = 0; x < source.screenWidth; x++)
+        {
+            int column = source.x + x + columnPadding;
+            linear[column] = toLinear[pixel[x] & 0xFF];
+            linear[paddedWidth + column] = toLinear[(pixel[x] >> 8) & 0xFF];
+            linear[2 * paddedWidth + column] = toLinear[(pixel[x] >> 16) & 0xFF];
+        }
+
+        const float *weight0 = columnWeights[0].data();
+        const float *weight1 = columnWeights[1].data();
+        const float *weight2 = columnWeights[2].data();
+        const float *weight3 = columnWeights[3].data();
+        for (int c = 0; c < 3; c++)
+        {
+            const float *input = linear + c * paddedWidth;
+            float *output = filtered + c * outputWidth;
+            for (int x = 0; x < outputWidth; x++)
+            {
+                const float *tap = input + columnStart[x];
+                output[x] = tap[0] * weight0[x] + tap[1] * weight1[x] + tap[2] * weight2[x] + tap[3] * weight3[x];
+            }
+        }
+
+        return filtered;
+    }
+
+    void CrtFilter::FinishRow(const float *colorA, const float *colorB, float weightA, float weightB, int y, uint32_t *destination, bool swapRedBlue) const
+    {
+        int maskRow = maskRows == 2 ? y & 1 : 0;
+        RowFinish row = {colorA, colorB, weightA, weightB,
+                         {mask[maskRow][0].data(), mask[maskRow][1].data(), mask[maskRow][2].data()},
+                         rowShade[y], toneScale, toneBias, toSrgb, (float)(linearLevels - 1), tableWidth * tableScale,
+                         swapRedBlue ? 16 : 0, swapRedBlue ? 0 : 16, destination};
+
+#ifdef RETROSIM_AVX2
+        if (HasAVX2())
+        {
+            FinishRowAVX2(row);
+            return;
+        }
+#endif
+        FinishRowScalar(row, 0);
+    }
+}
@@ -0,0 +1,80 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MMU.h"
+#include "WorkerPool.h"
+
+namespace RetroSim::GPU
+{
+    // The Lottes CRT shader of data/shaders on the CPU, for the outputs that don't go through a GPU (libretro's
+    // software framebuffer, captures). It takes the parameters from MMU::ShaderParameters and scales the image by an
+    // integer factor. Because of the integer scale every output row and column samples the same source pixels with the
+    // same weights in each frame, so the weights are kept in tables, rebuilt only when the parameters or the sizes change.
+    // The source rows are filtered horizontally once per band and combined vertically with the row weights. The
+    // curvature is applied as a remap of the flat image, which is combined from the filtered rows per pixel.
+    class CrtFilter
+    {
+    public:
+        // The screen is at (x, y) of a width x height image with a black border, its pixels are ABGR with the given pitch.
+        struct Source
+        {
+            const uint32_t *pixels;
+            int pitch;
+            int x, y;
+            int screenWidth, screenHeight;
+            int width, height;
+        };
+
+        void SetThreadCount(int threadCount);
+        // Writes (width * scale) x (height * scale) pixels, ABGR or, with swapRedBlue, XRGB. The pitch is in pixels.
+        void Apply(const Source &source, int scale, const MMU::ShaderParameters &parameters, uint32_t *destination, int destinationPitch, bool swapRedBlue);
+
+    private:
+        static const int linearLevels = 4096; // the precision of the linear color before it is converted back to sRGB
+        static const int columnPadding = 2;   // the filter reads up to two pixels beyond the image on both sides
+
+        struct Band
+        {
+            std::vector<float> linear;   // a source row in linear light, padded, one plane per channel
+            std::vector<float> rows[2];  // source rows filtered horizontally to the output width, one plane per channel
+            int rowIndex[2] = {};        // the source rows in rows, INT_MIN when empty
+        };
+
+        WorkerPool workerPool;
+        std::vector<Band> bands;
+
+        // the key of the tables
+        MMU::ShaderParameters tableParameters = {};
+        int tableWidth = 0;
+        int tableHeight = 0;
+        int tableScale = 0;
+
+        float toLinear[256];
+        uint32_t toSrgb[linearLevels];
+        // per output column: the first source column (padded) and the weights of the four taps
+        std::vector<int32_t> columnStart;
+        std::vector<float> columnWeights[4];
+        // per output row: the first source row and the weights of it and the next one, with the scanline shading
+        std::vector<int32_t> rowStart;
+        std::vector<float> rowWeights[2];
+        std::vector<float> rowShade;
+        // the phosphor mask of a row, per channel; the shadow mask alternates between two rows
+        std::vector<float> mask[2][3];
+        int maskRows = 1;
+        float toneScale = 1.0f;
+        float toneBias = 0.0f;
+        // with curvature: for each output pixel the pixel of the flat image it shows, x in the lowest 12 bits and y
+        // in the next 12, and its brightness in the upper 8; and the source rows filtered horizontally
+        std::vector<uint32_t> warpTable;
+        std::vector<float> filteredRows;
+
+        bool IsTableCurrent(const Source &source, int scale, const MMU::ShaderParameters &parameters) const;
+        void BuildTables(const Source &source, int scale, const MMU::ShaderParameters &parameters);
+        void BuildWarpTable(const MMU::ShaderParameters &parameters, int outputWidth, int outputHeight);
+        const float *GetFilteredRow(Band &band, const Source &source, int row) const;
+        void FinishRow(const float *colorA, const float *colorB, float weightA, float weightB, int y, uint32_t *destination, bool swapRedBlue) const;
+    };
+}
@@ -0,0 +1,114 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "DirtyRegion.h"
+#include <algorithm>
+
+namespace RetroSim::GPU
+{
+    // Beyond this many rectangles the per-upload overhead outweighs the saved bandwidth,
+    // the bounding rectangle is used instead.
+    const size_t maxDirtyRects = 16;
+
+    DirtyRegion::DirtyRegion()
+    {
+        Clear();
+    }
+
+    void DirtyRegion::Clear()
+    {
+        std::fill_n(left, textureHeight, (int16_t)textureWidth);
+        std::fill_n(right, textureHeight, (int16_t)-1);
+        top = textureHeight;
+        bottom = -1;
+    }
+
+    void DirtyRegion::MarkAll()
+    {
+        Mark(0, 0, textureWidth - 1, textureHeight - 1);
+    }
+
+    void DirtyRegion::Mark(int x0, int y0, int x1, int y1)
+    {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, (int)textureWidth - 1);
+        y1 = std::min(y1, (int)textureHeight - 1);
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        for (int y = y0; y <= y1; y++)
+        {
+            left[y] = std::min(left[y], (int16_t)x0);
+            right[y] = std::max(right[y], (int16_t)x1);
+        }
+
+        top = std::min(top, y0);
+        bottom = std::max(bottom, y1);
+    }
+
+    void DirtyRegion::Add(const DirtyRegion &other)
+    {
+        for (int y = other.top; y <= other.bottom; y++)
+        {
+            left[y] = std::min(left[y], other.left[y]);
+            right[y] = std::max(right[y], other.right[y]);
+        }
+
+        top = std::min(top, other.top);
+        bottom = std::max(bottom, other.bottom);
+    }
+
+    bool DirtyRegion::IsEmpty() const
+    {
+        return top > bottom;
+    }
+
+    bool DirtyRegion::GetColumns(int y0, int y1, int &x0, int &x1) const
+    {
+        x0 = textureWidth;
+        x1 = -1;
+
+        for (int y = std::max(y0, top); y <= std::min(y1, bottom); y++)
+        {
+            x0 = std::min(x0, (int)left[y]);
+            x1 = std::max(x1, (int)right[y]);
+        }
+
+        return x0 <= x1;
+    }
+
+    void DirtyRegion::GetRects(std::vector<DirtyRect> &rects) const
+    {
+        rects.clear();
+
+        int boundingLeft = textureWidth;
+        int boundingRight = -1;
+
+        for (int y = top; y <= bottom; y++)
+        {
+            if (left[y] > right[y])
+                continue;
+
+            int firstRow = y;
+            int rectLeft = left[y];
+            int rectRight = right[y];
+            while (y + 1 <= bottom && left[y + 1] <= right[y + 1])
+            {
+                y++;
+                rectLeft = std::min(rectLeft, (int)left[y]);
+                rectRight = std::max(rectRight, (int)right[y]);
+            }
+
+            rects.push_back({rectLeft, firstRow, rectRight - rectLeft + 1, y - firstRow + 1});
+            boundingLeft = std::min(boundingLeft, rectLeft);
+            boundingRight = std::max(boundingRight, rectRight);
+        }
+
+        if (rects.size() > maxDirtyRects)
+        {
+            rects.clear();
+            rects.push_back({boundingLeft, top, boundingRight - boundingLeft + 1, bottom - top + 1});
+        }
+    }
+}
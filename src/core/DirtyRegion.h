@@ -0,0 +1,43 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+
+namespace RetroSim::GPU
+{
+    struct DirtyRect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    // The part of the output texture changed by a frame, tracked as a span of columns per row.
+    class DirtyRegion
+    {
+    public:
+        DirtyRegion();
+
+        void Clear();
+        void MarkAll();
+        void Mark(int x0, int y0, int x1, int y1); // inclusive, clamped to the texture
+        void Add(const DirtyRegion &other);
+        bool IsEmpty() const;
+        // The span of dirty columns over the rows [y0, y1], false if none of them is dirty.
+        bool GetColumns(int y0, int y1, int &x0, int &x1) const;
+
+        // Consecutive dirty rows are merged into one rectangle covering their columns.
+        void GetRects(std::vector<DirtyRect> &rects) const;
+
+    private:
+        int16_t left[textureHeight];
+        int16_t right[textureHeight];
+        // bounding rows of the dirty rows, empty when top > bottom
+        int top;
+        int bottom;
+    };
+}
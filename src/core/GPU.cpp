@@ -4,28 +4,46 @@
 #include "GPU.h"
 #include "Core.h"
 #include "MMU.h"
+#include "CommandBuffer.h"
+#include "TripleBuffer.h"
+#include "PaletteAnimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
 #ifdef __APPLE__ // or shall we use __clang__?
 #include <stddef.h>
 #endif
 
 namespace RetroSim::GPU
 {
-    uint32_t *outputTexture = new uint32_t[textureWidth * textureHeight]; // RGBA8888;
-
-    // clipping rectangle
-    uint16_t clipX0 = 0;
-    uint16_t clipY0 = 0;
-    uint16_t clipX1 = 0;
-    uint16_t clipY1 = 0;
-
-    // for print()
-    uint8_t fontWidth = 8;
-    uint8_t fontHeight = 16;
-    uint32_t fontOffset = 0; // defines how many characters to skip at the start of CHARSET
+    // The buffers are cache line aligned and a row is 29 cache lines, so the bands rendered by different threads never share one.
+    TripleBuffer outputTexture(pixelCount);
+    PaletteAnimator paletteAnimator;
+    // the rows of the guest framebuffer recorded at the end of the frame, reused
+    std::vector<uint8_t> framebufferRows;
+    // the guest framebuffer was on in the previous frame, when it is turned on all of it is drawn
+    bool framebufferShown = false;
+    // the palette the rows of an indexed framebuffer were drawn with, when the palette changes all of them are drawn again
+    uint32_t framebufferPalette[256];
+    // the video mode of the frame being recorded
+    uint8_t videoMode = VIDEO_MODE_464X256;
+
+    static_assert(MMU::framebufferSize == pixelCount, "The guest framebuffer has to match the frame buffer");
 
     void Initialize()
     {
-        memset(outputTexture, 0, textureSizeInBytes);
+        // Commands recorded before initialization (e.g. by the script's start()) are drawn before the screen is cleared.
+        RenderFrame();
+        FinishFrame();
+
+        outputTexture.Clear();
+        commandBuffer.Invalidate();
+        commandBuffer.ResetClipping();
+        videoMode = VIDEO_MODE_464X256;
+        commandBuffer.SetVideoMode(videoMode);
+        commandBuffer.SetThreadCount(Core::GetInstance()->GetCoreConfig().GetRenderThreads());
+
         MMU::memory.gpu.screenWidth = textureWidth;
         MMU::memory.gpu.screenHeight = textureHeight;
         MMU::memory.gpu.tileWidth = 8;
@@ -33,162 +51,291 @@ namespace RetroSim::GPU
         MMU::memory.gpu.mapWidth = 30;
         MMU::memory.gpu.mapHeight = 16;
         MMU::memory.gpu.spriteAtlasPitch = 128;
-        DisableClipping();
-    }
+        MMU::memory.gpu.textMode = 0;
+        MMU::memory.gpu.textFontHeight = 16;
+        MMU::memory.gpu.textBackgroundColor = 0;
+        MMU::memory.gpu.spriteMode = 0;
+        MMU::memory.gpu.scanlineMode = 0;
+        MMU::memory.gpu.rasterIrqEnabled = 0;
+        MMU::memory.gpu.rasterIrqLine = 0;
+        MMU::memory.gpu.currentScanline = 0;
+        MMU::memory.gpu.framebufferMode = 0;
+        MMU::memory.gpu.videoMode = videoMode;
+        framebufferShown = false;
+
+        for (int i = 0; i < MMU::tileLayerCount; i++)
+        {
+            MMU::memory.tileLayers[i] = MMU::TileLayerRegisters{};
+            MMU::memory.affineLayers[i] = MMU::AffineLayerRegisters{0x10000, 0, 0, 0x10000};
+        }
 
-    void SetFont(int width, int height, int offset = 0)
-    {
-        fontWidth = width;
-        fontHeight = height;
-        fontOffset = offset;
+        for (int i = 0; i < MMU::paletteCycleCount; i++)
+            MMU::memory.paletteCycles[i] = MMU::PaletteCycleRegisters{};
+        for (int i = 0; i < MMU::paletteSwapCount; i++)
+            MMU::memory.paletteSwaps[i] = MMU::PaletteSwap{};
+        MMU::memory.paletteFade = MMU::PaletteFadeRegisters{};
     }
 
-    void RenderOpaqueText(const char *text, int x, int y, uint8_t colorIndex, uint8_t backgroundColorIndex)
+    // Turns the pages of the guest framebuffer written since the last frame into rows and records the rows' pixels.
+    // The rows are laid out as the video mode's screen, one or two bytes per pixel. An indexed framebuffer is drawn
+    // with the palette at the end of the frame, which is recorded with the rows: a palette change, by SetPaletteColor
+    // or by the palette animation, redraws every row.
+    void RecordFramebuffer()
     {
-        // int characterCount = 0;
-        while (char c = *text++)
+        const VideoModeInfo &info = GetVideoModeInfo(videoMode);
+        bool indexed = info.bytesPerPixel == 1;
+        bool paletteChanged = indexed && memcmp(framebufferPalette, MMU::memory.Palette_u32, sizeof(framebufferPalette)) != 0;
+        if (!framebufferShown || paletteChanged)
+            memset(MMU::framebufferDirtyPages, 0xFF, sizeof(MMU::framebufferDirtyPages));
+
+        uint32_t rowSize = info.width * info.bytesPerPixel;
+
+        uint8_t rowBits[textureHeight / 8] = {};
+        int firstRow = textureHeight;
+        int lastRow = -1;
+
+        for (uint32_t page = 0; page < MMU::framebufferPageCount; page++)
         {
-            for (int k = 0; k < fontHeight; k++)
-                for (int j = 0; j < fontWidth; j++)
-                {
-                    uint8_t currentPixelColorIndex = MMU::memory.Charset_u8[fontOffset + c * fontWidth * fontHeight + k * fontWidth + j];
+            if (!(MMU::framebufferDirtyPages[page / 64] & (1ull << (page % 64))))
+                continue;
 
-                    if (currentPixelColorIndex == 0)
-                        DrawPixel(x + j, y + k, backgroundColorIndex);
-                    else
-                        DrawPixel(x + j, y + k, colorIndex);
-                }
+            int pageFirstRow = (int)(page * MMU::framebufferPageSize / rowSize);
+            int pageLastRow = std::min((int)(((page + 1) * MMU::framebufferPageSize - 1) / rowSize), info.height - 1);
+            if (pageFirstRow > pageLastRow)
+                break;
+
+            for (int y = pageFirstRow; y <= pageLastRow; y++)
+                rowBits[y / 8] |= 1 << (y % 8);
+            firstRow = std::min(firstRow, pageFirstRow);
+            lastRow = std::max(lastRow, pageLastRow);
+        }
 
-            x += fontWidth;
+        memset(MMU::framebufferDirtyPages, 0, sizeof(MMU::framebufferDirtyPages));
+        if (lastRow < 0)
+            return;
+
+        framebufferRows.assign(rowBits, rowBits + sizeof(rowBits));
+        if (indexed)
+        {
+            memcpy(framebufferPalette, MMU::memory.Palette_u32, sizeof(framebufferPalette));
+            const uint8_t *palette = (const uint8_t *)framebufferPalette;
+            framebufferRows.insert(framebufferRows.end(), palette, palette + sizeof(framebufferPalette));
         }
+
+        for (int y = firstRow; y <= lastRow; y++)
+        {
+            if (rowBits[y / 8] & (1 << (y % 8)))
+            {
+                const uint8_t *row = MMU::memory.raw + MMU::FRAMEBUFFER_U8 + y * rowSize;
+                framebufferRows.insert(framebufferRows.end(), row, row + rowSize);
+            }
+        }
+
+        std::string_view rows((const char *)framebufferRows.data(), framebufferRows.size());
+        commandBuffer.Record(DrawFramebufferID, DrawFramebufferCommand{(uint16_t)firstRow, (uint16_t)lastRow}, rows);
     }
 
-    void RenderText(const char *text, int x, int y, uint8_t colorIndex)
+    // Rendering is pipelined: the render thread rasterizes frame N while the CPU and the script run frame N + 1.
+    // The frontends pick up each frame from outputTexture as soon as it is published.
+    void RenderFrame()
     {
-        // int characterCount = 0;
-        while (char c = *text++)
+        FinishFrame();
+
+        // the composed lines already show the swapped colors, the frame's commands and the next frame see the palette without them
+        paletteAnimator.RestoreSwaps();
+
+        // the written rows of the guest framebuffer go under the layers
+        framebufferShown = framebufferShown && MMU::memory.gpu.framebufferMode != 0;
+        if (MMU::memory.gpu.framebufferMode != 0)
+        {
+            RecordFramebuffer();
+            framebufferShown = true;
+        }
+
+        // the layers are drawn on top of everything else drawn in the frame: the tile layers, the text layer, then the sprites
+        if (!commandBuffer.GetScanlineLayer().IsEmpty())
+        {
+            // in scanline mode the layers were composed line by line during the frame
+            commandBuffer.Record(DrawScanlineLayerID, DrawScanlineLayerCommand{});
+        }
+        else
         {
-            for (int k = 0; k < fontHeight; k++)
-                for (int j = 0; j < fontWidth; j++)
+            bool tileLayersEnabled = false;
+            bool readsBitmap = false;
+            for (int i = 0; i < MMU::tileLayerCount; i++)
+            {
+                uint8_t flags = MMU::memory.tileLayers[i].flags;
+                if (flags & MMU::TILE_LAYER_ENABLED)
                 {
-                    uint8_t currentPixelColorIndex = MMU::memory.Charset_u8[fontOffset + c * fontWidth * fontHeight + k * fontWidth + j];
-                    if (currentPixelColorIndex == 0)
-                        continue;
-                    DrawPixel(x + j, y + k, colorIndex);
+                    tileLayersEnabled = true;
+                    readsBitmap |= (flags & MMU::TILE_LAYER_AFFINE) && (flags & MMU::TILE_LAYER_BITMAP);
                 }
+            }
+
+            if (tileLayersEnabled)
+                commandBuffer.Record(DrawTileLayersID, DrawTileLayersCommand{readsBitmap});
+
+            if (MMU::memory.gpu.textMode != 0)
+            {
+                uint8_t fontHeight = MMU::memory.gpu.textFontHeight == 8 ? 8 : 16;
+                commandBuffer.Record(DrawTextLayerID, DrawTextLayerCommand{fontHeight, MMU::memory.gpu.textBackgroundColor});
+            }
+
+            if (MMU::memory.gpu.spriteMode != 0)
+                commandBuffer.Record(DrawSpriteLayerID, DrawSpriteLayerCommand{MMU::memory.gpu.spriteAtlasPitch});
+        }
+
+        commandBuffer.Submit(outputTexture);
 
-            x += fontWidth;
+        // a new video mode starts with the next frame, on a cleared screen
+        uint8_t nextVideoMode = MMU::memory.gpu.videoMode <= VIDEO_MODE_232X128_RGB565 ? MMU::memory.gpu.videoMode : VIDEO_MODE_464X256;
+        if (nextVideoMode != videoMode)
+        {
+            videoMode = nextVideoMode;
+            commandBuffer.SetVideoMode(videoMode);
+            MMU::memory.gpu.screenWidth = GetVideoModeInfo(videoMode).width;
+            MMU::memory.gpu.screenHeight = GetVideoModeInfo(videoMode).height;
+            framebufferShown = false;
         }
+
+        // the frame has captured its palette, the animated colors show from the next frame, on the guest framebuffer too
+        paletteAnimator.Update();
+    }
+
+    void SetOutputFormat(uint8_t format)
+    {
+        commandBuffer.SetOutputFormat(format);
+        // the guest framebuffer's rows are resolved again, in the new order
+        framebufferShown = false;
+    }
+
+    void FinishFrame()
+    {
+        commandBuffer.WaitForFrame();
+    }
+
+    void RenderScanline(int y)
+    {
+        paletteAnimator.ApplySwaps(y);
+        commandBuffer.GetScanlineLayer().RenderLine(y, videoMode);
+    }
+
+    // The API functions below only record commands, they are rasterized on the render thread after RenderFrame().
+
+    void SetFont(int width, int height, int offset = 0)
+    {
+        commandBuffer.Record(SetFontID, SetFontCommand{width, height, offset});
+    }
+
+    void RenderOpaqueText(const char *text, int x, int y, uint8_t colorIndex, uint8_t backgroundColorIndex)
+    {
+        std::string_view characters(text);
+        commandBuffer.Record(RenderOpaqueTextID, RenderTextCommand{x, y, (uint32_t)characters.size(), colorIndex, backgroundColorIndex}, characters);
+    }
+
+    void RenderText(const char *text, int x, int y, uint8_t colorIndex)
+    {
+        std::string_view characters(text);
+        commandBuffer.Record(RenderTextID, RenderTextCommand{x, y, (uint32_t)characters.size(), colorIndex, 0}, characters);
     }
 
     void ClearScreen(uint8_t colorIndex)
     {
-        for (uint_fast16_t y = 0; y < textureHeight; y++)
-            for (uint_fast16_t x = 0; x < textureWidth; x++)
-                DrawPixel(x, y, colorIndex);
+        commandBuffer.Record(ClearScreenID, ClearScreenCommand{colorIndex});
     }
 
     void ClearScreenIgnoreClipping(uint8_t colorIndex)
     {
-        uint32_t color = GetPaletteColor(colorIndex);
-        size_t pixelCount = textureWidth * textureHeight;
-        for (size_t i = 0; i < pixelCount; i++)
-        {
-            outputTexture[i] = color;
-        }
+        commandBuffer.Record(ClearScreenIgnoreClippingID, ClearScreenCommand{colorIndex});
     }
 
     void DrawLine(int x0, int y0, int x1, int y1, uint8_t colorIndex)
     {
-        int dx = abs(x1 - x0);
-        int dy = abs(y1 - y0);
-        int sx = x0 < x1 ? 1 : -1;
-        int sy = y0 < y1 ? 1 : -1;
-        int err = dx - dy;
+        commandBuffer.Record(DrawLineID, DrawLineCommand{x0, y0, x1, y1, colorIndex});
+    }
 
-        while (true)
-        {
-            DrawPixel(x0, y0, colorIndex);
+    // The bounding box of a batch is computed here, so the command is culled and clipped as a whole and the
+    // coordinates are copied into the arena behind it.
+    void RecordBatch(APICalls id, const int32_t *values, int count, int valuesPerItem, uint8_t colorIndex, bool flag)
+    {
+        if (count <= 0)
+            return;
 
-            if (x0 == x1 && y0 == y1)
-                break;
+        int64_t left = INT64_MAX;
+        int64_t top = INT64_MAX;
+        int64_t right = INT64_MIN;
+        int64_t bottom = INT64_MIN;
 
-            int e2 = 2 * err;
-            if (e2 > -dy)
-            {
-                err -= dy;
-                x0 += sx;
-            }
+        for (int i = 0; i < count; i++)
+        {
+            const int32_t *item = values + (size_t)i * valuesPerItem;
+            int64_t x0 = item[0];
+            int64_t y0 = item[1];
+            int64_t x1 = x0;
+            int64_t y1 = y0;
 
-            if (e2 < dx)
+            if (valuesPerItem == 4)
             {
-                err += dx;
-                y0 += sy;
+                x1 = x0 + item[2];
+                y1 = y0 + item[3];
             }
+
+            left = std::min({left, x0, x1});
+            top = std::min({top, y0, y1});
+            right = std::max({right, x0, x1});
+            bottom = std::max({bottom, y0, y1});
         }
 
-        DrawPixel(x1, y1, colorIndex);
+        auto bound = [](int64_t value)
+        {
+            return (int32_t)std::clamp<int64_t>(value, INT32_MIN, INT32_MAX);
+        };
+
+        std::string_view coordinates((const char *)values, (size_t)count * valuesPerItem * sizeof(int32_t));
+        commandBuffer.Record(id, DrawBatchCommand{bound(left), bound(top), bound(right), bound(bottom), (uint32_t)count, colorIndex, flag}, coordinates);
+    }
+
+    void DrawPixels(const int32_t *points, int count, uint8_t colorIndex)
+    {
+        RecordBatch(DrawPixelsID, points, count, 2, colorIndex, false);
+    }
+
+    void DrawPolyline(const int32_t *vertices, int count, uint8_t colorIndex, bool closed)
+    {
+        RecordBatch(DrawPolylineID, vertices, count, 2, colorIndex, closed);
+    }
+
+    void DrawRects(const int32_t *rects, int count, uint8_t colorIndex, bool filled)
+    {
+        RecordBatch(DrawRectsID, rects, count, 4, colorIndex, filled);
     }
 
     void DrawCircle(int x, int y, int radius, uint8_t colorIndex, bool filled)
     {
-        // Compute the coordinates of the center of the circle
-        int cx = x;
-        int cy = y;
+        commandBuffer.Record(DrawCircleID, DrawCircleCommand{x, y, radius, colorIndex, filled});
+    }
 
-        // Compute the squared radius of the circle
-        int r2 = radius * radius;
+    void FloodFill(int x, int y, uint8_t colorIndex)
+    {
+        commandBuffer.Record(FloodFillID, FloodFillCommand{x, y, colorIndex});
+    }
 
-        // Loop over the pixels in the bounding box of the circle
-        for (int py = y - radius; py <= y + radius; py++)
-        {
-            for (int px = x - radius; px <= x + radius; px++)
-            {
-                // Compute the distance between the pixel and the center of the circle
-                int dx = px - cx;
-                int dy = py - cy;
-                int dx2 = dx * dx;
-                int dy2 = dy * dy;
-                int d2 = dx2 + dy2;
-
-                // Check if the pixel is inside the circle
-                if (d2 <= r2)
-                {
-                    // Draw the pixel
-                    if (filled || d2 >= r2 - 2 * radius)
-                    {
-                        DrawPixel(px, py, colorIndex);
-                    }
-                    else if ((dx2 + (dy - 1) * (dy - 1)) > r2 || (dx2 + (dy + 1) * (dy + 1)) > r2 || ((dx - 1) * (dx - 1) + dy2) > r2 || ((dx + 1) * (dx + 1) + dy2) > r2)
-                    {
-                        DrawPixel(px, py, colorIndex);
-                    }
-                }
-            }
-        }
+    void FillPolygon(const int32_t *vertices, int count, uint8_t colorIndex)
+    {
+        if (count < 3)
+            return;
+
+        RecordBatch(FillPolygonID, vertices, count, 2, colorIndex, false);
     }
 
     void DrawRect(int x, int y, int width, int height, uint8_t colorIndex, bool filled)
     {
-        if (filled)
-        {
-            for (int i = 0; i < height; i++)
-                DrawLine(x, y + i, x + width, y + i, colorIndex);
-        }
-        else
-        {
-            DrawLine(x, y, x + width, y, colorIndex);
-            DrawLine(x + width, y, x + width, y + height, colorIndex);
-            DrawLine(x + width, y + height, x, y + height, colorIndex);
-            DrawLine(x, y + height, x, y, colorIndex);
-        }
+        commandBuffer.Record(DrawRectID, DrawRectCommand{x, y, width, height, colorIndex, filled});
     }
 
     void DrawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t colorIndex, bool filled)
     {
-        DrawLine(x0, y0, x1, y1, colorIndex);
-        DrawLine(x1, y1, x2, y2, colorIndex);
-        DrawLine(x2, y2, x0, y0, colorIndex);
+        commandBuffer.Record(DrawTriangleID, DrawTriangleCommand{x0, y0, x1, y1, x2, y2, colorIndex, filled});
     }
 
     void DrawTexturedTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int u0, int v0, int u1, int v1, int u2, int v2)
@@ -197,96 +344,102 @@ namespace RetroSim::GPU
 
     void DrawPixel(int x, int y, uint8_t colorIndex)
     {
-        if (x < clipX0 || x > clipX1 || y < clipY0 || y > clipY1)
-            return;
-
-        outputTexture[x + y * textureWidth] = GetPaletteColor(colorIndex);
+        commandBuffer.Record(DrawPixelID, DrawPixelCommand{x, y, colorIndex});
     }
 
     void SetClipping(int x0, int y0, int x1, int y1)
     {
-        clipX0 = x0;
-        clipY0 = y0;
-        clipX1 = x1;
-        clipY1 = y1;
+        commandBuffer.Record(SetClippingID, SetClippingCommand{x0, y0, x1, y1});
     }
 
     void DisableClipping()
     {
-        clipX0 = 0;
-        clipY0 = 0;
-        clipX1 = textureWidth - 1;
-        clipY1 = textureHeight - 1;
+        commandBuffer.Record(DisableClippingID, DisableClippingCommand{});
     }
 
-    void DrawMap(int screenX, int screenY, int mapX, int mapY, int width, int height, int16_t transparentColorIndex = -1)
+    void SetBlendMode(uint8_t mode)
     {
-        uint8_t tileWidth = MMU::memory.gpu.tileWidth;
-        uint8_t tileHeight = MMU::memory.gpu.tileHeight;
-        uint8_t mapWidth = MMU::memory.gpu.mapWidth;
-        // uint8_t mapHeight = MMU::memory.gpu.mapHeight;
+        commandBuffer.Record(SetBlendModeID, SetBlendModeCommand{mode});
+    }
 
-        for (int tileY = mapY; tileY < mapY + height; tileY++)
-        {
-            for (int tileX = mapX; tileX < mapX + width; tileX++)
-            {
-                int tileIndex = MMU::memory.Map_u8[tileX + tileY * mapWidth];
-                int tileOffset = tileIndex * tileWidth * tileHeight;
+    void SetStencilMode(uint8_t mode)
+    {
+        commandBuffer.Record(SetStencilModeID, SetStencilModeCommand{mode});
+    }
 
-                for (int tileMemY = 0; tileMemY < tileHeight; tileMemY++)
-                {
-                    for (int tileMemX = 0; tileMemX < tileWidth; tileMemX++)
-                    {
-                        int colorIndex = MMU::memory.Bitmap_u8[tileOffset + tileMemX + tileMemY * tileWidth];
-                        if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
-                            continue;
+    void ClearStencil(bool value)
+    {
+        commandBuffer.Record(ClearStencilID, ClearStencilCommand{value});
+    }
 
-                        int pixelCoordX = screenX + (tileX - mapX) * tileWidth + tileMemX;
-                        int pixelCoordY = screenY + (tileY - mapY) * tileHeight + tileMemY;
+    void CopyRect(int srcX, int srcY, int width, int height, int dstX, int dstY)
+    {
+        commandBuffer.Record(CopyRectID, CopyRectCommand{srcX, srcY, width, height, dstX, dstY});
+    }
 
-                        DrawPixel(pixelCoordX, pixelCoordY, colorIndex);
-                    }
-                }
-            }
-        }
+    void Scroll(int dx, int dy)
+    {
+        commandBuffer.Record(ScrollID, ScrollCommand{dx, dy});
+    }
+
+    void DrawMap(int screenX, int screenY, int mapX, int mapY, int width, int height, int16_t transparentColorIndex = -1)
+    {
+        MMU::GPURegisters &gpu = MMU::memory.gpu;
+        commandBuffer.Record(DrawMapID, DrawMapCommand{screenX, screenY, mapX, mapY, width, height, transparentColorIndex, gpu.tileWidth, gpu.tileHeight, gpu.mapWidth});
     }
 
     void DrawSprite(int screenPosX, int screenPosY, int spritePosX, int spritePosY, int width, int height, int16_t transparentColorIndex = -1)
     {
-        uint8_t pitch = MMU::memory.gpu.spriteAtlasPitch;
+        commandBuffer.Record(DrawSpriteID, DrawSpriteCommand{screenPosX, screenPosY, spritePosX, spritePosY, width, height, transparentColorIndex, MMU::memory.gpu.spriteAtlasPitch});
+    }
 
-        for (int y = 0; y < height; y++)
+    // The inverse transformation maps the screen to the atlas. It is computed here, so the render thread steps through
+    // the atlas in fixed point, and so is the bounding box, which the command is culled and clipped with.
+    void DrawTransformedSprite(int x, int y, int spritePosX, int spritePosY, int width, int height, float scaleX, float scaleY, float angle, int16_t transparentColorIndex)
+    {
+        const float minimumScale = 1.0f / 256;
+        if (!(std::fabs(scaleX) >= minimumScale && std::fabs(scaleY) >= minimumScale) || !std::isfinite(angle) || width <= 0 || height <= 0)
+            return;
+
+        double cosine = std::cos((double)angle);
+        double sine = std::sin((double)angle);
+        int32_t matrix[4] = {
+            (int32_t)std::lround(cosine / scaleX * 65536),
+            (int32_t)std::lround(sine / scaleX * 65536),
+            (int32_t)std::lround(-sine / scaleY * 65536),
+            (int32_t)std::lround(cosine / scaleY * 65536),
+        };
+
+        // half the size of the rotated rectangle, with a pixel to spare for rounding
+        double extentX = (std::fabs(cosine * scaleX) * width + std::fabs(sine * scaleY) * height) / 2 + 1;
+        double extentY = (std::fabs(sine * scaleX) * width + std::fabs(cosine * scaleY) * height) / 2 + 1;
+        auto bound = [](double value)
         {
-            int spriteOffset = spritePosX + (spritePosY + y) * pitch;
-            for (int x = 0; x < width; x++)
-            {
-                int colorIndex = MMU::memory.SpriteAtlas_u8[spriteOffset + x];
-                if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
-                    continue;
-                DrawPixel(screenPosX + x, screenPosY + y, colorIndex);
-            }
-        }
+            return (int32_t)std::clamp(value, -1e9, 1e9);
+        };
+
+        commandBuffer.Record(DrawTransformedSpriteID, DrawTransformedSpriteCommand{x, y, spritePosX, spritePosY, width, height,
+                                                                                   {matrix[0], matrix[1], matrix[2], matrix[3]},
+                                                                                   bound(std::floor(x - extentX)), bound(std::floor(y - extentY)), bound(std::ceil(x + extentX)), bound(std::ceil(y + extentY)),
+                                                                                   transparentColorIndex, MMU::memory.gpu.spriteAtlasPitch});
     }
 
     void DrawBitmap(int screenPosX, int screenPosY, int bitmapPosX, int bitmapPosY, int width, int height, int pitch = textureWidth, int16_t transparentColorIndex)
     {
-        for (int y = 0; y < height; y++)
-        {
-            int bitmapOffset = bitmapPosX + (bitmapPosY + y) * pitch;
-            for (int x = 0; x < width; x++)
-            {
-                int colorIndex = MMU::memory.Bitmap_u8[bitmapOffset + x];
-                if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
-                    continue;
-                DrawPixel(screenPosX + x, screenPosY + y, colorIndex);
-            }
-        }
+        commandBuffer.Record(DrawBitmapID, DrawBitmapCommand{screenPosX, screenPosY, bitmapPosX, bitmapPosY, width, height, pitch, transparentColorIndex});
     }
 
-    // TODO: test
     void SetPaletteColor(int index, int r, int g, int b)
     {
-        MMU::memory.Palette_u32[index] = b << 16 | g << 8 | r;
+        // the palette has 256 entries, an index outside of it changes nothing
+        if (index < 0 || index > 255)
+            return;
+
+        // The palette memory is updated right away, the recorded command keeps the draws of the frame in order.
+        uint8_t colorIndex = (uint8_t)index;
+        uint32_t color = (uint32_t)(b & 0xFF) << 16 | (uint32_t)(g & 0xFF) << 8 | (uint32_t)(r & 0xFF);
+        MMU::memory.Palette_u32[colorIndex] = color;
+        commandBuffer.Record(SetPaletteColorID, SetPaletteColorCommand{color, colorIndex});
     }
 
     uint32_t GetPaletteColor(uint8_t colorIndex)
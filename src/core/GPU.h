@@ -13,9 +13,24 @@ namespace RetroSim::GPU
     const uint_fast32_t pixelCount = textureWidth * textureHeight;
     const uint_fast32_t textureSizeInBytes = pixelCount * 4;
 
-    extern uint32_t *outputTexture; // ARGB8888;
+    class TripleBuffer;
+    extern TripleBuffer outputTexture; // 32 bit pixels in the OutputFormat set, written by the render thread, read by the frontends
 
     void Initialize();
+    void RenderFrame(); // hands the commands recorded during the frame to the render thread, which publishes the result in outputTexture
+    void FinishFrame(); // waits until the render thread is done with the last submitted frame
+    void RenderScanline(int y); // in scanline mode, composes line y of the layers after the CPU ran it
+
+    // The channel order of the output texture's pixels, so a frontend can show them without swizzling. The palette
+    // colors are converted once when they are captured, the rasterizers never see the difference.
+    enum OutputFormat
+    {
+        OUTPUT_ABGR8888, // red in the lowest byte, as the palette colors are stored
+        OUTPUT_ARGB8888, // blue in the lowest byte, libretro's XRGB8888
+    };
+
+    // Takes effect from the next frame, the pixels already drawn keep their order until they are drawn again.
+    void SetOutputFormat(uint8_t format); // OutputFormat, unknown formats select OUTPUT_ABGR8888
 
     enum APICalls
     {
@@ -36,8 +51,77 @@ namespace RetroSim::GPU
         DrawBitmapID,
         SetClippingID,
         DisableClippingID,
+        DrawTextLayerID,     // recorded by RenderFrame() when the text layer is on
+        DrawSpriteLayerID,   // recorded by RenderFrame() when the sprite attribute table is on
+        DrawScanlineLayerID, // recorded by RenderFrame() when lines were composed in scanline mode
+        DrawTileLayersID,    // recorded by RenderFrame() when a tile layer is enabled
+        SetBlendModeID,
+        CopyRectID,
+        ScrollID,
+        DrawTransformedSpriteID,
+        DrawPixelsID,
+        DrawPolylineID,
+        DrawRectsID,
+        FloodFillID,
+        FillPolygonID,
+        SetStencilModeID,
+        ClearStencilID,
+        DrawFramebufferID,   // recorded by RenderFrame() when rows of the guest framebuffer were written
+    };
+
+    // How the primitives, maps, sprites and bitmaps combine their colors with the pixels under them. The blend is
+    // computed per color channel: additive and subtractive saturate, average is 50% translucency and multiply darkens.
+    // Text, screen clears, flood fills and the layers always replace the pixels.
+    enum BlendMode
+    {
+        BLEND_NONE,
+        BLEND_ADD,
+        BLEND_SUBTRACT,
+        BLEND_AVERAGE,
+        BLEND_MULTIPLY,
+    };
+
+    // How the primitives, maps, sprites and bitmaps use the stencil, a bit per pixel that is kept from frame to frame. In the
+    // write modes they set or clear the stencil bits of the pixels they would draw and leave the pixels alone, in the test
+    // modes they only draw where the bit is set (inside) or clear (outside).
+    enum StencilMode
+    {
+        STENCIL_OFF,
+        STENCIL_SET,
+        STENCIL_CLEAR,
+        STENCIL_INSIDE,
+        STENCIL_OUTSIDE,
     };
 
+    // Selected with the videoMode GPU register, a new mode takes effect from the next frame. The low resolution modes
+    // use the top left 232x128 pixels of the frame buffer, which the frontends show doubled, so the frame costs a quarter
+    // to draw. In the direct color mode the guest framebuffer holds RGB565 pixels instead of palette indices.
+    enum VideoMode
+    {
+        VIDEO_MODE_464X256,
+        VIDEO_MODE_232X128,
+        VIDEO_MODE_232X128_RGB565,
+    };
+
+    struct VideoModeInfo
+    {
+        uint16_t width;        // the part of the frame buffer shown
+        uint16_t height;
+        uint8_t scale;         // the frontends show every pixel as scale x scale pixels
+        uint8_t bytesPerPixel; // in the guest framebuffer
+    };
+
+    // unknown modes are shown as 464x256
+    inline const VideoModeInfo &GetVideoModeInfo(uint8_t videoMode)
+    {
+        static const VideoModeInfo modes[] = {
+            {464, 256, 1, 1},
+            {232, 128, 2, 1},
+            {232, 128, 2, 2},
+        };
+        return modes[videoMode < sizeof(modes) / sizeof(modes[0]) ? videoMode : VIDEO_MODE_464X256];
+    }
+
     // API
     void SetFont(int width, int height, int offset);
     void SetPaletteColor(int index, int r, int g, int b);
@@ -48,14 +132,31 @@ namespace RetroSim::GPU
     void DrawPixel(int x, int y, uint8_t colorIndex);
     void DrawLine(int x0, int y0, int x1, int y1, uint8_t colorIndex);
     void DrawRect(int x, int y, int width, int height, uint8_t colorIndex, bool filled);
+    // Batches, recorded as a single command. The coordinates are packed: x, y for every point and vertex, x, y, width, height for every rect.
+    void DrawPixels(const int32_t *points, int count, uint8_t colorIndex);
+    void DrawPolyline(const int32_t *vertices, int count, uint8_t colorIndex, bool closed); // closed connects the last vertex to the first
+    void DrawRects(const int32_t *rects, int count, uint8_t colorIndex, bool filled);
     void DrawCircle(int x, int y, int radius, uint8_t colorIndex, bool filled);
+    // Fills the area of pixels with the color of (x, y) that is connected to it horizontally or vertically, inside the clipping rectangle.
+    void FloodFill(int x, int y, uint8_t colorIndex);
+    // Fills the pixels whose centers are inside the polygon, by the even-odd rule. The vertices are packed as in the batches.
+    void FillPolygon(const int32_t *vertices, int count, uint8_t colorIndex);
     void DrawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t colorIndex, bool filled);
     void DrawTexturedTriangle(int x0, int y0, int x1, int y1, int x2, int y2, int u0, int v0, int u1, int v1, int u2, int v2);
     void DrawMap(int screenX, int screenY, int mapX, int mapY, int width, int height, int16_t transparentColorIndex);
     void DrawSprite(int x, int y, int spritex, int spritey, int width, int height, int16_t transparentColorIndex);
+    // Draws a sprite scaled, then rotated by angle radians around its center, which is placed at (x, y). Negative scales flip it.
+    void DrawTransformedSprite(int x, int y, int spritex, int spritey, int width, int height, float scaleX, float scaleY, float angle, int16_t transparentColorIndex = -1);
     void DrawBitmap(int screenPosX, int screenPosY, int bitmapPosX, int bitmapPosY, int width, int height, int pitch, int16_t transparentColorIndex = -1);
     void SetClipping(int x0, int y0, int x1, int y1);
     void DisableClipping();
+    void SetBlendMode(uint8_t mode); // BlendMode, unknown modes select BLEND_NONE
+    void SetStencilMode(uint8_t mode); // StencilMode, unknown modes select STENCIL_OFF
+    void ClearStencil(bool value); // sets or clears the stencil bits of the clipping rectangle
+    // Moves screen contents, the rectangles may overlap. The destination is clipped, the layers aren't copied.
+    void CopyRect(int srcX, int srcY, int width, int height, int dstX, int dstY);
+    // Moves the contents of the clipping rectangle, the uncovered strip keeps its pixels until it is drawn over.
+    void Scroll(int dx, int dy);
 
     // Helper functions
     uint32_t GetPaletteColor(uint8_t colorIndex);
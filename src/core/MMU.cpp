@@ -9,6 +9,7 @@ using namespace RetroSim::Logger;
 namespace RetroSim::MMU
 {
     MemorySections memory;
+    uint64_t framebufferDirtyPages[(framebufferPageCount + 63) / 64] = {};
 
     int LoadFileToAddress(const std::string& path, uint32_t address)
     {
@@ -28,6 +29,7 @@ namespace RetroSim::MMU
         }
         
         memcpy(memory.raw + address, buffer, fileSize);
+        MarkFramebufferWritten(address, (uint32_t)fileSize);
         delete buffer;
 
         return 0;
@@ -23,11 +23,37 @@ namespace RetroSim::MMU
         GPU_REGISTERS = 0xD000,     // GPU registers
         GENERAL_REGISTERS = 0xD100, // General registers
         SHADER_PARAMETERS = 0xD200, // Shader parameters
-        PALETTE_U32 = 0xE000,       // Color palette memory (4K)
+        SPRITE_ATTRIBUTES = 0xD300, // Sprite attribute table, 256 SpriteAttributes (3K)
+        TILE_LAYERS = 0xDF00,       // Tile layer registers, 4 TileLayerRegisters then 4 AffineLayerRegisters (256 bytes)
+        PALETTE_U32 = 0xE000,       // Color palette memory (1K)
+        PALETTE_ANIMATION = 0xE400, // Palette animation registers, 8 PaletteCycleRegisters, PaletteFadeRegisters, then 64 PaletteSwaps at +$100 (1K)
+        PALETTE_FADE_TARGET_U32 = 0xE800, // The colors the palette fades to (1K)
+        TEXT_SCREEN_U8 = 0xF000,    // Text layer character codes, one byte per cell (2K)
+        TEXT_COLOR_U8 = 0xF800,     // Text layer foreground color indices, one byte per cell (2K)
         BITMAP_U8 = 0x10000,        // Bitmap memory (120K)
-        CHARSET_U8 = 0x30000        // Character tile data (64K)
+        CHARSET_U8 = 0x30000,       // Character tile data, 1bpp rows (64K)
+        FRAMEBUFFER_U8 = 0x40000    // Guest framebuffer, a palette index (or an RGB565 color) per pixel of the video mode, up to 464x256 (116K)
     };
 
+    const uint_fast32_t framebufferSize = 464 * 256; // GPU::textureWidth * GPU::textureHeight
+    // Writes to the framebuffer are tracked in pages, a bit per page, for the GPU to pick up the changed rows.
+    const uint_fast32_t framebufferPageSize = 256;
+    const uint_fast32_t framebufferPageCount = framebufferSize / framebufferPageSize;
+    extern uint64_t framebufferDirtyPages[(framebufferPageCount + 63) / 64];
+
+    inline void MarkFramebufferWritten(uint32_t address, uint32_t size)
+    {
+        int64_t first = (int64_t)address - FRAMEBUFFER_U8;
+        int64_t last = first + size - 1;
+        first = first > 0 ? first : 0;
+        last = last < (int64_t)framebufferSize - 1 ? last : (int64_t)framebufferSize - 1;
+        if (first > last)
+            return;
+
+        for (int64_t page = first / framebufferPageSize; page <= last / (int64_t)framebufferPageSize; page++)
+            framebufferDirtyPages[page / 64] |= 1ull << (page % 64);
+    }
+
     struct GPURegisters
     {
         uint16_t screenWidth;
@@ -37,6 +63,129 @@ namespace RetroSim::MMU
         uint8_t mapWidth;
         uint8_t mapHeight;
         uint8_t spriteAtlasPitch;
+        uint8_t textMode;            // 0: text layer off, 1: on
+        uint8_t textFontHeight;      // 8 or 16, the layer has textureHeight / textFontHeight rows of 58 cells
+        uint8_t textBackgroundColor; // palette index of the cell background
+        uint8_t spriteMode;          // 0: sprite attribute table off, 1: on
+        uint8_t scanlineMode;        // 0: the layers are drawn once per frame, 1: a line at a time, interleaved with the CPU
+        uint8_t rasterIrqEnabled;    // in scanline mode, 1: raises an IRQ before the CPU runs rasterIrqLine
+        uint16_t rasterIrqLine;
+        uint16_t currentScanline;    // in scanline mode, the line the CPU is running
+        uint8_t framebufferMode;     // 0: off, 1: the rows written to FRAMEBUFFER_U8 are drawn at the end of the frame, under the layers
+        uint8_t videoMode;           // GPU::VideoMode, takes effect from the next frame and sets screenWidth and screenHeight
+    };
+
+    const int spriteCount = 256;
+
+    enum SpriteFlags
+    {
+        SPRITE_ENABLED = 1,
+        SPRITE_FLIP_X = 2,
+        SPRITE_FLIP_Y = 4,
+        SPRITE_TRANSPARENT = 8,    // pixels with transparentColorIndex aren't drawn
+        SPRITE_PRIORITY_SHIFT = 4, // bits 4-5: higher priority sprites are drawn in front, then lower indices
+        SPRITE_PRIORITY_MASK = 3 << SPRITE_PRIORITY_SHIFT,
+    };
+
+    // An entry of the sprite attribute table. The image is read from the sprite atlas.
+    struct SpriteAttributes
+    {
+        int16_t x; // screen position of the top left corner
+        int16_t y;
+        uint8_t atlasX;
+        uint8_t atlasY;
+        uint8_t width;
+        uint8_t height;
+        uint8_t flags; // SpriteFlags
+        uint8_t transparentColorIndex;
+        uint8_t reserved[2];
+    };
+
+    const int tileLayerCount = 4;
+
+    enum TileLayerFlags
+    {
+        TILE_LAYER_ENABLED = 1,
+        TILE_LAYER_WRAP = 2,        // the map repeats in both directions, otherwise nothing is drawn outside of it
+        TILE_LAYER_TRANSPARENT = 4, // pixels with transparentColorIndex show the layers behind
+        TILE_LAYER_AFFINE = 8,      // sampled through the layer's AffineLayerRegisters instead of scrolled
+        TILE_LAYER_BITMAP = 16,     // with TILE_LAYER_AFFINE: samples a bitmap in BITMAP_U8 instead of the map
+    };
+
+    // A background layer: a map of tile indices, scrolled over the screen.
+    struct TileLayerRegisters
+    {
+        uint16_t mapOffset;  // offset of the map in MAP_U8, mapWidth * mapHeight tile indices, row by row
+        uint16_t tileOffset; // offset of the tile bank in TILES_U8, tileWidth * tileHeight bytes per tile
+        int16_t scrollX;     // the map pixel at the top left corner of the screen, unused by affine layers
+        int16_t scrollY;
+        uint8_t mapWidth; // in tiles
+        uint8_t mapHeight;
+        uint8_t tileWidth;
+        uint8_t tileHeight;
+        uint8_t flags;    // TileLayerFlags
+        uint8_t priority; // higher priority layers are in front, then lower indices
+        uint8_t transparentColorIndex;
+        uint8_t reserved;
+    };
+
+    // The transformation of a layer with TILE_LAYER_AFFINE, in 16.16 fixed point. Screen pixel (x, y) shows the
+    // layer pixel (originX + x * a + y * b, originY + x * c + y * d). In scanline mode the registers can be changed
+    // between lines for perspective effects.
+    struct AffineLayerRegisters
+    {
+        int32_t a;
+        int32_t b;
+        int32_t c;
+        int32_t d;
+        int32_t originX;
+        int32_t originY;
+        uint32_t bitmapOffset; // with TILE_LAYER_BITMAP: offset of the bitmap in BITMAP_U8, one byte per pixel
+        uint16_t bitmapWidth;  // also the pitch
+        uint16_t bitmapHeight;
+    };
+
+    const int paletteCycleCount = 8;
+
+    enum PaletteCycleFlags
+    {
+        PALETTE_CYCLE_ENABLED = 1,
+        PALETTE_CYCLE_REVERSE = 2, // the colors move towards the lower indices
+    };
+
+    // Rotates the colors [first, last] of the palette by one entry every period frames.
+    struct PaletteCycleRegisters
+    {
+        uint8_t first;
+        uint8_t last;
+        uint8_t period; // in frames, 0 counts as 1
+        uint8_t flags;  // PaletteCycleFlags
+        uint8_t timer;  // frames since the last step
+        uint8_t reserved[3];
+    };
+
+    // Moves the colors [first, last] of the palette towards PALETTE_FADE_TARGET_U32, which they reach in the given number of frames.
+    struct PaletteFadeRegisters
+    {
+        uint16_t frames; // counts down to 0, the fade is over at 0
+        uint8_t first;
+        uint8_t last;
+    };
+
+    const int paletteSwapCount = 64;
+
+    enum PaletteSwapFlags
+    {
+        PALETTE_SWAP_ENABLED = 1,
+    };
+
+    // In scanline mode, changes a palette color before the line is composed. The previous color is restored at the end of the frame.
+    struct PaletteSwap
+    {
+        uint16_t line;
+        uint8_t index;
+        uint8_t flags; // PaletteSwapFlags
+        uint32_t color;
     };
 
     struct GeneralRegisters
@@ -71,15 +220,25 @@ namespace RetroSim::MMU
         uint32_t *Palette_u32;
         uint8_t *Bitmap_u8;
         uint8_t *Charset_u8;
+        uint8_t *TextScreen_u8;
+        uint8_t *TextColor_u8;
+        SpriteAttributes *spriteAttributes;
+        TileLayerRegisters *tileLayers;
+        AffineLayerRegisters *affineLayers;
+        uint32_t *PaletteFadeTarget_u32;
+        PaletteCycleRegisters *paletteCycles;
+        PaletteSwap *paletteSwaps;
 
         GPURegisters &gpu;
         GeneralRegisters &generalRegisters;
         ShaderParameters &shaderParameters;
+        PaletteFadeRegisters &paletteFade;
 
         MemorySections()
             : gpu(*reinterpret_cast<GPURegisters *>(&raw[GPU_REGISTERS])), // Initializing references in the constructor's initialization list
               generalRegisters(*reinterpret_cast<GeneralRegisters *>(&raw[GENERAL_REGISTERS])),
-              shaderParameters(*reinterpret_cast<ShaderParameters *>(&raw[SHADER_PARAMETERS]))
+              shaderParameters(*reinterpret_cast<ShaderParameters *>(&raw[SHADER_PARAMETERS])),
+              paletteFade(*reinterpret_cast<PaletteFadeRegisters *>(&raw[PALETTE_ANIMATION + paletteCycleCount * sizeof(PaletteCycleRegisters)]))
         {
             memset(raw, 0, memorySize);
             Map_u8 = &raw[MAP_U8];
@@ -88,6 +247,14 @@ namespace RetroSim::MMU
             Palette_u32 = (uint32_t *)&raw[PALETTE_U32];
             Bitmap_u8 = &raw[BITMAP_U8];
             Charset_u8 = &raw[CHARSET_U8];
+            TextScreen_u8 = &raw[TEXT_SCREEN_U8];
+            TextColor_u8 = &raw[TEXT_COLOR_U8];
+            spriteAttributes = (SpriteAttributes *)&raw[SPRITE_ATTRIBUTES];
+            tileLayers = (TileLayerRegisters *)&raw[TILE_LAYERS];
+            affineLayers = (AffineLayerRegisters *)&raw[TILE_LAYERS + tileLayerCount * sizeof(TileLayerRegisters)];
+            PaletteFadeTarget_u32 = (uint32_t *)&raw[PALETTE_FADE_TARGET_U32];
+            paletteCycles = (PaletteCycleRegisters *)&raw[PALETTE_ANIMATION];
+            paletteSwaps = (PaletteSwap *)&raw[PALETTE_ANIMATION + 0x100];
         }
     };
 
@@ -113,6 +280,9 @@ namespace RetroSim::MMU
         if (address < (memorySize - sizeof(T)))
         {
             *(T *)(memory.raw + address) = value;
+            // also catches a write that starts right before the framebuffer
+            if (address + sizeof(T) - 1 - FRAMEBUFFER_U8 < framebufferSize + sizeof(T) - 1)
+                MarkFramebufferWritten(address, sizeof(T));
         }
         else
         {
@@ -0,0 +1,73 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "OverlayBackground.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    OverlayBackground::OverlayBackground()
+        : background(pixelCount)
+    {
+        Invalidate();
+        previousSpans = spans;
+    }
+
+    void OverlayBackground::Invalidate()
+    {
+        std::fill_n(spans.left, textureHeight, (int16_t)textureWidth);
+        std::fill_n(spans.right, textureHeight, (int16_t)-1);
+        visible = false;
+    }
+
+    void OverlayBackground::BeginFrame()
+    {
+        previousSpans = spans;
+        previouslyVisible = visible;
+        Invalidate();
+    }
+
+    void OverlayBackground::Cover(int y, int x0, int x1)
+    {
+        spans.left[y] = (int16_t)std::min((int)spans.left[y], x0);
+        spans.right[y] = (int16_t)std::max((int)spans.right[y], x1);
+        visible = true;
+    }
+
+    void OverlayBackground::MarkDirty(DirtyRegion &dirtyRegion) const
+    {
+        if (!previouslyVisible && !visible)
+            return;
+
+        for (int y = 0; y < (int)textureHeight; y++)
+        {
+            int left = std::min(previousSpans.left[y], spans.left[y]);
+            int right = std::max(previousSpans.right[y], spans.right[y]);
+            if (left <= right)
+                dirtyRegion.Mark(left, y, right, y);
+        }
+    }
+
+    void OverlayBackground::Restore(uint32_t *target, int y0, int y1) const
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            int left = previousSpans.left[y];
+            int right = previousSpans.right[y];
+            if (left <= right)
+                memcpy(target + y * textureWidth + left, background.data() + y * textureWidth + left, (right - left + 1) * sizeof(uint32_t));
+        }
+    }
+
+    void OverlayBackground::Save(const uint32_t *target, int y0, int y1)
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            int left = spans.left[y];
+            int right = spans.right[y];
+            if (left <= right)
+                memcpy(background.data() + y * textureWidth + left, target + y * textureWidth + left, (right - left + 1) * sizeof(uint32_t));
+        }
+    }
+}
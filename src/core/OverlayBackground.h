@@ -0,0 +1,50 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+#include "DirtyRegion.h"
+
+namespace RetroSim::GPU
+{
+    // The pixels under a layer that isn't part of the persistent output. They are saved before the layer is drawn
+    // and restored at the start of the next frame, so a moving layer doesn't leave a trail behind.
+    class OverlayBackground
+    {
+    public:
+        OverlayBackground();
+
+        // Starts a new frame, the spans covered so far become the ones to restore.
+        void BeginFrame();
+        // Adds the columns [x0, x1] of row y to the part of the frame the layer covers.
+        void Cover(int y, int x0, int x1);
+        // Adds the rows covered in the previous and in the new frame to dirtyRegion.
+        void MarkDirty(DirtyRegion &dirtyRegion) const;
+
+        // Puts back the pixels under the layer of the previous frame, in the rows [y0, y1].
+        void Restore(uint32_t *target, int y0, int y1) const;
+        // Saves the pixels the layer is about to cover, in the rows [y0, y1].
+        void Save(const uint32_t *target, int y0, int y1);
+
+        // true if the layer is on the screen, even a frame without commands has to remove it
+        bool IsVisible() const { return visible; }
+        // The output was cleared, there is nothing under the layer to restore.
+        void Invalidate();
+
+    private:
+        // the covered columns of each row, empty when left > right
+        struct Spans
+        {
+            int16_t left[textureHeight];
+            int16_t right[textureHeight];
+        };
+        Spans spans;
+        Spans previousSpans;
+        bool visible = false;
+        bool previouslyVisible = false;
+
+        std::vector<uint32_t> background; // the saved pixels, at their screen positions
+    };
+}
@@ -0,0 +1,87 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "PaletteAnimator.h"
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    void PaletteAnimator::Update()
+    {
+        for (int i = 0; i < MMU::paletteCycleCount; i++)
+            Cycle(MMU::memory.Palette_u32, MMU::memory.paletteCycles[i]);
+
+        Fade(MMU::memory.Palette_u32, MMU::memory.PaletteFadeTarget_u32, MMU::memory.paletteFade);
+    }
+
+    void PaletteAnimator::Cycle(uint32_t *palette, MMU::PaletteCycleRegisters &cycle)
+    {
+        if (!(cycle.flags & MMU::PALETTE_CYCLE_ENABLED) || cycle.first >= cycle.last)
+            return;
+
+        cycle.timer++;
+        if (cycle.timer < cycle.period)
+            return;
+        cycle.timer = 0;
+
+        uint32_t *colors = palette + cycle.first;
+        int count = cycle.last - cycle.first;
+
+        if (cycle.flags & MMU::PALETTE_CYCLE_REVERSE)
+        {
+            uint32_t first = colors[0];
+            memmove(colors, colors + 1, count * sizeof(uint32_t));
+            colors[count] = first;
+        }
+        else
+        {
+            uint32_t last = colors[count];
+            memmove(colors + 1, colors, count * sizeof(uint32_t));
+            colors[0] = last;
+        }
+    }
+
+    // Every frame each channel covers 1 / frames of the remaining distance, so the last step lands on the target.
+    void PaletteAnimator::Fade(uint32_t *palette, const uint32_t *target, MMU::PaletteFadeRegisters &fade)
+    {
+        if (fade.frames == 0)
+            return;
+
+        for (int i = fade.first; i <= fade.last; i++)
+        {
+            uint32_t color = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                int from = (palette[i] >> shift) & 0xFF;
+                int to = (target[i] >> shift) & 0xFF;
+                color |= (uint32_t)(from + (to - from) / fade.frames) << shift;
+            }
+            palette[i] = color;
+        }
+
+        fade.frames--;
+    }
+
+    void PaletteAnimator::ApplySwaps(int y)
+    {
+        for (int i = 0; i < MMU::paletteSwapCount; i++)
+        {
+            const MMU::PaletteSwap &swap = MMU::memory.paletteSwaps[i];
+            if (!(swap.flags & MMU::PALETTE_SWAP_ENABLED) || swap.line != y || replacedCount == MMU::paletteSwapCount)
+                continue;
+
+            replacedColors[replacedCount++] = ReplacedColor{swap.index, MMU::memory.Palette_u32[swap.index]};
+            MMU::memory.Palette_u32[swap.index] = swap.color;
+        }
+    }
+
+    // in reverse order, so an index swapped several times gets the color it had before the first swap
+    void PaletteAnimator::RestoreSwaps()
+    {
+        while (replacedCount > 0)
+        {
+            const ReplacedColor &replaced = replacedColors[--replacedCount];
+            MMU::memory.Palette_u32[replaced.index] = replaced.color;
+        }
+    }
+}
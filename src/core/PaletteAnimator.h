@@ -0,0 +1,38 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include "MMU.h"
+
+namespace RetroSim::GPU
+{
+    // Animates the palette from the registers at PALETTE_ANIMATION, so scripts don't have to rewrite colors every frame:
+    // color cycles rotate ranges of the palette, the fade moves a range towards PALETTE_FADE_TARGET_U32, and in scanline
+    // mode the swaps change colors between lines. It works on the palette in memory on the CPU thread, the layers and
+    // the commands recorded afterwards pick up the new colors. So does an indexed guest framebuffer: a step of a cycle
+    // or a fade changes the palette it was drawn with, and all of its rows are drawn again with the next frame.
+    class PaletteAnimator
+    {
+    public:
+        // Advances the cycles and the fade by a frame. Called at the end of the frame, the result is shown from the next one.
+        void Update();
+        // Applies the swaps of line y, before the line is composed.
+        void ApplySwaps(int y);
+        // Puts back the colors the swaps of the frame replaced.
+        void RestoreSwaps();
+
+    private:
+        struct ReplacedColor
+        {
+            uint8_t index;
+            uint32_t color;
+        };
+
+        ReplacedColor replacedColors[MMU::paletteSwapCount];
+        int replacedCount = 0;
+
+        static void Cycle(uint32_t *palette, MMU::PaletteCycleRegisters &cycle);
+        static void Fade(uint32_t *palette, const uint32_t *target, MMU::PaletteFadeRegisters &fade);
+    };
+}
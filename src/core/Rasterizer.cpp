@@ -0,0 +1,1437 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "Rasterizer.h"
+#include "MMU.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "Simd.h"
+
+namespace RetroSim::GPU::Rasterizer
+{
+    void ConvertPalette(uint32_t *destination, const uint32_t *palette, uint8_t outputFormat)
+    {
+        for (int i = 0; i < 256; i++)
+            destination[i] = ConvertColor(palette[i], outputFormat);
+    }
+
+    void SetFont(RenderState &state, int width, int height, int offset)
+    {
+        state.fontWidth = width;
+        state.fontHeight = height;
+        state.fontOffset = offset;
+    }
+
+    void SetPaletteColor(RenderState &state, uint8_t index, uint32_t color)
+    {
+        state.palette[index] = ConvertColor(color, state.outputFormat);
+        state.paletteVersion = state.nextPaletteVersion++;
+    }
+
+    void SetBlendMode(RenderState &state, uint8_t mode)
+    {
+        state.blendMode = mode <= BLEND_MULTIPLY ? mode : BLEND_NONE;
+    }
+
+    void SetStencilMode(RenderState &state, uint8_t mode)
+    {
+        state.stencilMode = mode <= STENCIL_OUTSIDE ? mode : STENCIL_OFF;
+    }
+
+    void ClearStencil(RenderState &state, bool value)
+    {
+        for (int y = state.clipY0; y <= state.clipY1; y++)
+        {
+            uint64_t *words = state.stencil + y * stencilRowWords;
+
+            for (int x = state.clipX0; x <= state.clipX1;)
+            {
+                int bit = x & 63;
+                int bits = std::min(64 - bit, state.clipX1 - x + 1);
+                uint64_t mask = (bits == 64 ? ~0ull : (1ull << bits) - 1) << bit;
+                words[x >> 6] = value ? words[x >> 6] | mask : words[x >> 6] & ~mask;
+                x += bits;
+            }
+        }
+    }
+
+    // Combines source with the destination pixel channel by channel, the alpha byte is taken from the source.
+    inline uint32_t BlendColor(uint8_t blendMode, uint32_t destination, uint32_t source)
+    {
+        uint32_t result = source & 0xFF000000;
+
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            uint32_t d = (destination >> shift) & 0xFF;
+            uint32_t s = (source >> shift) & 0xFF;
+            uint32_t channel;
+
+            switch (blendMode)
+            {
+            case BLEND_ADD:
+                channel = std::min(d + s, 255u);
+                break;
+            case BLEND_SUBTRACT:
+                channel = d > s ? d - s : 0;
+                break;
+            case BLEND_AVERAGE:
+                channel = (d + s) >> 1;
+                break;
+            case BLEND_MULTIPLY:
+                channel = (d * s + 127) / 255;
+                break;
+            default:
+                channel = s;
+                break;
+            }
+
+            result |= channel << shift;
+        }
+
+        return result;
+    }
+
+    inline void WritePixel(const RenderState &state, uint32_t *pixel, uint32_t color)
+    {
+        *pixel = state.blendMode == BLEND_NONE ? color : BlendColor(state.blendMode, *pixel, color);
+    }
+
+    inline void WritePixels(const RenderState &state, uint32_t *pixel, int count, uint32_t color)
+    {
+        if (state.blendMode == BLEND_NONE)
+        {
+            std::fill_n(pixel, count, color);
+            return;
+        }
+
+        for (int i = 0; i < count; i++)
+            pixel[i] = BlendColor(state.blendMode, pixel[i], color);
+    }
+
+    // Applies the stencil to count pixels of a row, starting at pixel. The row is walked a stencil word at a time: the
+    // write modes change the bits of the word at once, the test modes fill the pixels of the word at once when it lets
+    // all of them through and skip them when it masks all of them, only the others are drawn bit by bit.
+    void StencilPixels(const RenderState &state, uint32_t *pixel, int count, uint32_t color)
+    {
+        size_t offset = pixel - state.target;
+        int y = (int)(offset / textureWidth);
+        int x = (int)(offset - (size_t)y * textureWidth);
+        int end = x + count;
+        uint64_t *words = state.stencil + y * stencilRowWords;
+        uint32_t *row = state.target + y * textureWidth;
+
+        while (x < end)
+        {
+            int bit = x & 63;
+            int bits = std::min(64 - bit, end - x);
+            uint64_t mask = (bits == 64 ? ~0ull : (1ull << bits) - 1) << bit;
+            uint64_t &word = words[x >> 6];
+
+            uint64_t draw;
+            switch (state.stencilMode)
+            {
+            case STENCIL_SET:
+                word |= mask;
+                draw = 0;
+                break;
+            case STENCIL_CLEAR:
+                word &= ~mask;
+                draw = 0;
+                break;
+            case STENCIL_INSIDE:
+                draw = word & mask;
+                break;
+            default:
+                draw = ~word & mask;
+                break;
+            }
+
+            uint32_t *wordPixels = row + (x & ~63);
+            if (draw == mask)
+            {
+                WritePixels(state, wordPixels + bit, bits, color);
+            }
+            else
+            {
+                for (; draw != 0; draw &= draw - 1)
+                    WritePixel(state, wordPixels + std::countr_zero(draw), color);
+            }
+
+            x += bits;
+        }
+    }
+
+    inline void PutPixel(const RenderState &state, uint32_t *pixel, uint32_t color)
+    {
+        if (state.stencilMode != STENCIL_OFF)
+            StencilPixels(state, pixel, 1, color);
+        else
+            WritePixel(state, pixel, color);
+    }
+
+    inline void FillPixels(const RenderState &state, uint32_t *pixel, int count, uint32_t color)
+    {
+        if (state.stencilMode != STENCIL_OFF)
+            StencilPixels(state, pixel, count, color);
+        else
+            WritePixels(state, pixel, count, color);
+    }
+
+    // Clips a width x height rectangle at (x, y) to the clipping rectangle. The visible part is returned
+    // relative to the rectangle's origin in [firstX, lastX] and [firstY, lastY].
+    bool ClipRect(const RenderState &state, int x, int y, int width, int height, int &firstX, int &firstY, int &lastX, int &lastY)
+    {
+        firstX = (int)std::max<int64_t>(0, (int64_t)state.clipX0 - x);
+        firstY = (int)std::max<int64_t>(0, (int64_t)state.clipY0 - y);
+        lastX = (int)std::min<int64_t>((int64_t)width - 1, (int64_t)state.clipX1 - x);
+        lastY = (int)std::min<int64_t>((int64_t)height - 1, (int64_t)state.clipY1 - y);
+
+        return firstX <= lastX && firstY <= lastY;
+    }
+
+    const uint32_t mapMemorySize = MMU::TILES_U8 - MMU::MAP_U8;
+    const uint32_t tileMemorySize = MMU::SPRITE_ATLAS_U8 - MMU::TILES_U8;
+    const uint32_t spriteAtlasSize = MMU::GPU_REGISTERS - MMU::SPRITE_ATLAS_U8;
+    const uint32_t charsetSize = 0x10000;
+    const uint32_t bitmapMemorySize = MMU::CHARSET_U8 - MMU::BITMAP_U8;
+
+    // For every value of a glyph mask byte the 8 pixels it covers, all bits set where the glyph bit is set.
+    // Pixels are then computed without branches: (color & mask) | (background & ~mask).
+    struct GlyphMaskTable
+    {
+        uint32_t masks[256][8];
+
+        GlyphMaskTable()
+        {
+            for (int value = 0; value < 256; value++)
+                for (int bit = 0; bit < 8; bit++)
+                    masks[value][bit] = (value & (0x80 >> bit)) ? 0xFFFFFFFF : 0;
+        }
+    };
+
+    const GlyphMaskTable glyphMaskTable;
+
+    // Expands the pixels [first, last] of a glyph mask byte. Transparent text keeps the pixels under the unset bits.
+    inline void ExpandGlyphByte(uint32_t *pixel, const uint32_t *mask, int first, int last, uint32_t color, uint32_t backgroundColor, bool opaque)
+    {
+        if (opaque)
+        {
+            for (int i = first; i <= last; i++)
+                pixel[i] = (color & mask[i]) | (backgroundColor & ~mask[i]);
+        }
+        else
+        {
+            for (int i = first; i <= last; i++)
+                pixel[i] = (color & mask[i]) | (pixel[i] & ~mask[i]);
+        }
+    }
+
+    // The font is stored in CHARSET as 1bpp rows, each row padded to whole bytes with the leftmost pixel in the
+    // most significant bit. Every glyph is clipped once, then its rows are expanded a mask byte at a time.
+    void RenderGlyphs(RenderState &state, const char *text, uint32_t length, int x, int y, uint8_t colorIndex, int16_t backgroundColorIndex)
+    {
+        int rowSize = (state.fontWidth + 7) / 8;
+        uint32_t glyphSize = rowSize * state.fontHeight;
+        uint32_t color = state.palette[colorIndex];
+        bool opaque = backgroundColorIndex != -1;
+        uint32_t backgroundColor = opaque ? state.palette[backgroundColorIndex] : 0;
+
+        for (uint32_t i = 0; i < length; i++, x += state.fontWidth)
+        {
+            int firstX, firstY, lastX, lastY;
+            if (!ClipRect(state, x, y, state.fontWidth, state.fontHeight, firstX, firstY, lastX, lastY))
+                continue;
+
+            uint8_t c = text[i];
+            uint64_t glyphOffset = state.fontOffset + (uint64_t)c * glyphSize;
+            if (glyphOffset + glyphSize > charsetSize)
+                continue;
+
+            const uint8_t *glyph = state.charset + glyphOffset;
+            int firstByte = firstX / 8;
+            int lastByte = lastX / 8;
+
+            for (int k = firstY; k <= lastY; k++)
+            {
+                uint32_t *pixel = state.target + (y + k) * textureWidth + x;
+                const uint8_t *glyphRow = glyph + k * rowSize;
+
+                for (int byte = firstByte; byte <= lastByte; byte++)
+                {
+                    uint8_t bits = glyphRow[byte];
+                    if (bits == 0 && !opaque)
+                        continue;
+
+                    const uint32_t *mask = glyphMaskTable.masks[bits];
+                    int first = byte == firstByte ? firstX % 8 : 0;
+                    int last = byte == lastByte ? lastX % 8 : 7;
+
+                    if (first == 0 && last == 7)
+                        ExpandGlyphByte(pixel + byte * 8, mask, 0, 7, color, backgroundColor, opaque);
+                    else
+                        ExpandGlyphByte(pixel + byte * 8, mask, first, last, color, backgroundColor, opaque);
+                }
+            }
+        }
+    }
+
+    void RenderOpaqueText(RenderState &state, const char *text, uint32_t length, int x, int y, uint8_t colorIndex, uint8_t backgroundColorIndex)
+    {
+        RenderGlyphs(state, text, length, x, y, colorIndex, backgroundColorIndex);
+    }
+
+    void RenderText(RenderState &state, const char *text, uint32_t length, int x, int y, uint8_t colorIndex)
+    {
+        RenderGlyphs(state, text, length, x, y, colorIndex, -1);
+    }
+
+    void ClearScreen(RenderState &state, uint8_t colorIndex)
+    {
+        uint32_t color = state.palette[colorIndex];
+        for (int y = state.clipY0; y <= state.clipY1; y++)
+            std::fill_n(state.target + y * textureWidth + state.clipX0, state.clipX1 - state.clipX0 + 1, color);
+    }
+
+    void ClearScreenIgnoreClipping(RenderState &state, uint8_t colorIndex)
+    {
+        // the band still applies, it isn't part of the clipping visible to the guest
+        uint32_t color = state.palette[colorIndex];
+        std::fill(state.target + state.bandY0 * textureWidth, state.target + (state.bandY1 + 1) * textureWidth, color);
+    }
+
+    // Cohen-Sutherland region codes relative to the clipping rectangle
+    enum OutCode
+    {
+        INSIDE = 0,
+        LEFT = 1,
+        RIGHT = 2,
+        BOTTOM = 4,
+        TOP = 8
+    };
+
+    int ComputeOutCode(RenderState &state, int x, int y)
+    {
+        int code = INSIDE;
+
+        if (x < state.clipX0)
+            code |= LEFT;
+        else if (x > state.clipX1)
+            code |= RIGHT;
+
+        if (y < state.clipY0)
+            code |= TOP;
+        else if (y > state.clipY1)
+            code |= BOTTOM;
+
+        return code;
+    }
+
+    void DrawHorizontalLine(RenderState &state, int x0, int x1, int y, uint8_t colorIndex)
+    {
+        if (y < state.clipY0 || y > state.clipY1)
+            return;
+
+        if (x0 > x1)
+            std::swap(x0, x1);
+
+        x0 = std::max(x0, state.clipX0);
+        x1 = std::min(x1, state.clipX1);
+        if (x0 > x1)
+            return;
+
+        FillPixels(state, state.target + y * textureWidth + x0, x1 - x0 + 1, state.palette[colorIndex]);
+    }
+
+    void DrawVerticalLine(RenderState &state, int x, int y0, int y1, uint8_t colorIndex)
+    {
+        if (x < state.clipX0 || x > state.clipX1)
+            return;
+
+        if (y0 > y1)
+            std::swap(y0, y1);
+
+        y0 = std::max(y0, state.clipY0);
+        y1 = std::min(y1, state.clipY1);
+
+        uint32_t color = state.palette[colorIndex];
+        uint32_t *pixel = state.target + y0 * textureWidth + x;
+        for (int y = y0; y <= y1; y++)
+        {
+            PutPixel(state, pixel, color);
+            pixel += textureWidth;
+        }
+    }
+
+    // floor((2 * a * b + c) / (2 * d)) and its remainder, for a, b < 2^32, 0 < d < 2^32 and |c| < 2^33. The deltas of a
+    // line reach 2^32, so the products of DrawLine don't fit in 64 signed bits, but a * b fits in 64 unsigned bits.
+    // Quotients too large to be a step of a line are returned as INT64_MAX.
+    int64_t DivideScaledProduct(uint64_t a, uint64_t b, int64_t c, uint64_t d, int64_t &remainder)
+    {
+        uint64_t product = a * b;
+        uint64_t quotient = product / d;
+        int64_t twoD = 2 * (int64_t)d;
+        int64_t rest = 2 * (int64_t)(product % d) + c;
+        int64_t restQuotient = rest >= 0 ? rest / twoD : -((twoD - 1 - rest) / twoD);
+        remainder = rest - restQuotient * twoD;
+        return quotient >= (1ull << 62) ? INT64_MAX : (int64_t)quotient + restQuotient;
+    }
+
+    // Returns the step range [first, last] along the major axis for which the minor coordinate
+    // minor0 + minorSign * floor((2 * step * minorDelta + majorDelta - 1) / (2 * majorDelta))
+    // stays within [minorMin, minorMax]. This is the closed form of the Bresenham walk used by DrawLine.
+    bool ClipMinorAxis(int64_t minor0, int minorSign, int64_t minorDelta, int64_t majorDelta, int64_t minorMin, int64_t minorMax, int64_t &first, int64_t &last)
+    {
+        int64_t lowestOffset = minorSign > 0 ? minorMin - minor0 : minor0 - minorMax;
+        int64_t highestOffset = minorSign > 0 ? minorMax - minor0 : minor0 - minorMin;
+
+        if (highestOffset < 0)
+            return false;
+
+        int64_t remainder;
+        if (lowestOffset > 0)
+            first = std::max(first, DivideScaledProduct(majorDelta, lowestOffset, 2 * minorDelta - majorDelta, minorDelta, remainder));
+
+        last = std::min(last, DivideScaledProduct(majorDelta, highestOffset + 1, -majorDelta, minorDelta, remainder));
+
+        return first <= last;
+    }
+
+    void DrawLine(RenderState &state, int x0, int y0, int x1, int y1, uint8_t colorIndex)
+    {
+        int outCode0 = ComputeOutCode(state, x0, y0);
+        int outCode1 = ComputeOutCode(state, x1, y1);
+
+        // both end points are on the same outer side of the clipping rectangle
+        if (outCode0 & outCode1)
+            return;
+
+        if (y0 == y1)
+        {
+            DrawHorizontalLine(state, x0, x1, y0, colorIndex);
+            return;
+        }
+
+        if (x0 == x1)
+        {
+            DrawVerticalLine(state, x0, y0, y1, colorIndex);
+            return;
+        }
+
+        int64_t dx = std::abs((int64_t)x1 - x0);
+        int64_t dy = std::abs((int64_t)y1 - y0);
+        int sx = x0 < x1 ? 1 : -1;
+        int sy = y0 < y1 ? 1 : -1;
+
+        // Walk along the major axis, the minor axis advances when the error term overflows.
+        bool xMajor = dx >= dy;
+        int64_t majorDelta = xMajor ? dx : dy;
+        int64_t minorDelta = xMajor ? dy : dx;
+
+        int64_t first = 0;
+        int64_t last = majorDelta;
+
+        if (outCode0 | outCode1)
+        {
+            int64_t major0 = xMajor ? x0 : y0;
+            int majorSign = xMajor ? sx : sy;
+            int64_t majorMin = xMajor ? state.clipX0 : state.clipY0;
+            int64_t majorMax = xMajor ? state.clipX1 : state.clipY1;
+
+            first = std::max(first, majorSign > 0 ? majorMin - major0 : major0 - majorMax);
+            last = std::min(last, majorSign > 0 ? majorMax - major0 : major0 - majorMin);
+            if (first > last)
+                return;
+
+            bool visible = xMajor ? ClipMinorAxis(y0, sy, dy, dx, state.clipY0, state.clipY1, first, last)
+                                  : ClipMinorAxis(x0, sx, dx, dy, state.clipX0, state.clipX1, first, last);
+            if (!visible)
+                return;
+        }
+
+        // the deltas reach 2^32, so the error terms stay 64 bit
+        int64_t error;
+        int64_t minorOffset = DivideScaledProduct(first, minorDelta, majorDelta - 1, majorDelta, error);
+
+        int startX = (int)(xMajor ? x0 + sx * first : x0 + sx * minorOffset);
+        int startY = (int)(xMajor ? y0 + sy * minorOffset : y0 + sy * first);
+
+        int majorStep = xMajor ? sx : sy * (int)textureWidth;
+        int minorStep = xMajor ? sy * (int)textureWidth : sx;
+        int64_t errorStep = 2 * minorDelta;
+        int64_t errorLimit = 2 * majorDelta;
+
+        uint32_t color = state.palette[colorIndex];
+        uint32_t *pixel = state.target + startX + startY * textureWidth;
+
+        for (int64_t i = first; i <= last; i++)
+        {
+            PutPixel(state, pixel, color);
+            pixel += majorStep;
+            error += errorStep;
+
+            // all bits set when the minor axis has to advance
+            int carry = -(error >= errorLimit);
+            pixel += minorStep & carry;
+            error -= errorLimit & carry;
+        }
+    }
+
+    void DrawCircle(RenderState &state, int x, int y, int radius, uint8_t colorIndex, bool filled)
+    {
+        // Compute the coordinates of the center of the circle
+        int cx = x;
+        int cy = y;
+
+        // Compute the squared radius of the circle
+        int r2 = radius * radius;
+
+        // Loop over the pixels in the visible part of the bounding box of the circle
+        int firstY = std::max(y - radius, state.clipY0);
+        int lastY = std::min(y + radius, state.clipY1);
+        int firstX = std::max(x - radius, state.clipX0);
+        int lastX = std::min(x + radius, state.clipX1);
+
+        for (int py = firstY; py <= lastY; py++)
+        {
+            for (int px = firstX; px <= lastX; px++)
+            {
+                // Compute the distance between the pixel and the center of the circle
+                int dx = px - cx;
+                int dy = py - cy;
+                int dx2 = dx * dx;
+                int dy2 = dy * dy;
+                int d2 = dx2 + dy2;
+
+                // Check if the pixel is inside the circle
+                if (d2 <= r2)
+                {
+                    // Draw the pixel
+                    if (filled || d2 >= r2 - 2 * radius)
+                    {
+                        DrawPixel(state, px, py, colorIndex);
+                    }
+                    else if ((dx2 + (dy - 1) * (dy - 1)) > r2 || (dx2 + (dy + 1) * (dy + 1)) > r2 || ((dx - 1) * (dx - 1) + dy2) > r2 || ((dx + 1) * (dx + 1) + dy2) > r2)
+                    {
+                        DrawPixel(state, px, py, colorIndex);
+                    }
+                }
+            }
+        }
+    }
+
+    // The seed fill from Graphics Gems ("A Seed Fill Algorithm", Paul Heckbert): every span popped from the stack is the
+    // filled run of the row next to it, which is scanned for runs of the old color. These are filled and pushed, and so
+    // are the parts that stick out beyond the parent run, to scan the row they came from.
+    void FloodFill(RenderState &state, int x, int y, uint8_t colorIndex)
+    {
+        if (x < state.clipX0 || x > state.clipX1 || y < state.clipY0 || y > state.clipY1)
+            return;
+
+        uint32_t *target = state.target;
+        uint32_t oldColor = target[y * textureWidth + x];
+        uint32_t newColor = state.palette[colorIndex];
+        if (oldColor == newColor)
+            return;
+
+        std::vector<FillBuffers::Span> &stack = state.fillBuffers->spans;
+        stack.clear();
+
+        auto push = [&](int spanY, int left, int right, int dy)
+        {
+            if (spanY + dy >= state.clipY0 && spanY + dy <= state.clipY1)
+                stack.push_back({spanY, left, right, dy});
+        };
+
+        push(y, x, x, 1);
+        push(y + 1, x, x, -1);
+
+        while (!stack.empty())
+        {
+            FillBuffers::Span span = stack.back();
+            stack.pop_back();
+
+            int row = span.y + span.dy;
+            uint32_t *pixels = target + row * textureWidth;
+
+            // extend to the left of the parent span
+            int px = span.left;
+            while (px >= state.clipX0 && pixels[px] == oldColor)
+                pixels[px--] = newColor;
+
+            int left;
+            if (px >= span.left)
+            {
+                // nothing under the start of the parent span, look for the next run under it
+                for (px++; px <= span.right && pixels[px] != oldColor; px++)
+                    ;
+                if (px > span.right)
+                    continue;
+                left = px;
+            }
+            else
+            {
+                left = px + 1;
+                if (left < span.left)
+                    push(row, left, span.left - 1, -span.dy); // leaked to the left
+                px = span.left + 1;
+            }
+
+            do
+            {
+                while (px <= state.clipX1 && pixels[px] == oldColor)
+                    pixels[px++] = newColor;
+
+                push(row, left, px - 1, span.dy);
+                if (px > span.right + 1)
+                    push(row, span.right + 1, px - 1, -span.dy); // leaked to the right
+
+                for (px++; px <= span.right && pixels[px] != oldColor; px++)
+                    ;
+                left = px;
+            } while (px <= span.right);
+        }
+    }
+
+    void FillPolygon(RenderState &state, const int32_t *vertices, uint32_t count, uint8_t colorIndex)
+    {
+        if (count < 3 || state.clipY0 > state.clipY1)
+            return;
+
+        std::vector<FillBuffers::Edge> &edges = state.fillBuffers->edges;
+        std::vector<FillBuffers::Edge> &active = state.fillBuffers->activeEdges;
+        edges.clear();
+        active.clear();
+
+        // The edge table: the edges that cross the center of a row of the clipping rectangle, the horizontal ones never do.
+        // A row's center is at y + 0.5, so an edge from y0 to y1 (y0 < y1) crosses the centers of rows [y0, y1 - 1].
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t next = i + 1 < count ? i + 1 : 0;
+            int64_t x0 = vertices[i * 2];
+            int64_t y0 = vertices[i * 2 + 1];
+            int64_t x1 = vertices[next * 2];
+            int64_t y1 = vertices[next * 2 + 1];
+            if (y0 == y1)
+                continue;
+            if (y0 > y1)
+            {
+                std::swap(x0, x1);
+                std::swap(y0, y1);
+            }
+
+            int64_t firstRow = std::max<int64_t>(y0, state.clipY0);
+            int64_t lastRow = std::min<int64_t>(y1 - 1, state.clipY1);
+            if (firstRow > lastRow)
+                continue;
+
+            edges.push_back({(int)firstRow, (int)lastRow, (double)x0, (double)y0, (double)(x1 - x0), (double)(y1 - y0), 0});
+        }
+
+        std::sort(edges.begin(), edges.end(), [](const FillBuffers::Edge &a, const FillBuffers::Edge &b)
+                  { return a.firstRow < b.firstRow; });
+
+        uint32_t color = state.palette[colorIndex];
+        size_t nextEdge = 0;
+
+        for (int y = edges.empty() ? 0 : edges.front().firstRow; nextEdge < edges.size() || !active.empty(); y++)
+        {
+            active.erase(std::remove_if(active.begin(), active.end(), [y](const FillBuffers::Edge &edge)
+                                        { return edge.lastRow < y; }),
+                         active.end());
+            while (nextEdge < edges.size() && edges[nextEdge].firstRow <= y)
+                active.push_back(edges[nextEdge++]);
+
+            // (x0 * 2dy + (2 * (y - y0) + 1) * dx) / 2dy is exact for integer coordinates up to 2^25, so a crossing
+            // that falls on a pixel's center is found exactly
+            for (FillBuffers::Edge &edge : active)
+                edge.crossing = (2 * edge.x0 * edge.dy + (2 * (y - edge.y0) + 1) * edge.dx) / (2 * edge.dy);
+
+            // the active edges stay sorted by their crossings from row to row, unless they cross each other
+            for (size_t i = 1; i < active.size(); i++)
+                for (size_t j = i; j > 0 && active[j].crossing < active[j - 1].crossing; j--)
+                    std::swap(active[j], active[j - 1]);
+
+            // a pixel is filled if its center is in [left, right) of a span between two crossings
+            uint32_t *row = state.target + y * textureWidth;
+            for (size_t i = 0; i + 1 < active.size(); i += 2)
+            {
+                double left = std::max(std::ceil(active[i].crossing - 0.5), (double)state.clipX0);
+                double right = std::min(std::ceil(active[i + 1].crossing - 0.5) - 1, (double)state.clipX1);
+                if (left <= right)
+                    FillPixels(state, row + (int)left, (int)right - (int)left + 1, color);
+            }
+        }
+    }
+
+    void DrawRect(RenderState &state, int x, int y, int width, int height, uint8_t colorIndex, bool filled)
+    {
+        if (filled)
+        {
+            int first = (int)std::max<int64_t>(0, (int64_t)state.clipY0 - y);
+            int last = (int)std::min<int64_t>((int64_t)height - 1, (int64_t)state.clipY1 - y);
+            for (int i = first; i <= last; i++)
+                DrawHorizontalLine(state, x, x + width, y + i, colorIndex);
+        }
+        else
+        {
+            DrawLine(state, x, y, x + width, y, colorIndex);
+            DrawLine(state, x + width, y, x + width, y + height, colorIndex);
+            DrawLine(state, x + width, y + height, x, y + height, colorIndex);
+            DrawLine(state, x, y + height, x, y, colorIndex);
+        }
+    }
+
+    void DrawTriangle(RenderState &state, int x0, int y0, int x1, int y1, int x2, int y2, uint8_t colorIndex, bool filled)
+    {
+        DrawLine(state, x0, y0, x1, y1, colorIndex);
+        DrawLine(state, x1, y1, x2, y2, colorIndex);
+        DrawLine(state, x2, y2, x0, y0, colorIndex);
+    }
+
+    void DrawPixel(RenderState &state, int x, int y, uint8_t colorIndex)
+    {
+        if (x < state.clipX0 || x > state.clipX1 || y < state.clipY0 || y > state.clipY1)
+            return;
+
+        PutPixel(state, state.target + x + y * textureWidth, state.palette[colorIndex]);
+    }
+
+    void DrawPixels(RenderState &state, const int32_t *points, uint32_t count, uint8_t colorIndex)
+    {
+        // an empty clipping rectangle (e.g. a band outside of it) would wrap the sizes below around
+        if (state.clipX0 > state.clipX1 || state.clipY0 > state.clipY1)
+            return;
+
+        uint32_t color = state.palette[colorIndex];
+        // one unsigned compare per axis, coordinates left of or above the clipping rectangle wrap around
+        uint32_t width = (uint32_t)(state.clipX1 - state.clipX0);
+        uint32_t height = (uint32_t)(state.clipY1 - state.clipY0);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t x = (uint32_t)points[i * 2] - (uint32_t)state.clipX0;
+            uint32_t y = (uint32_t)points[i * 2 + 1] - (uint32_t)state.clipY0;
+            if (x > width || y > height)
+                continue;
+
+            PutPixel(state, state.target + (state.clipY0 + y) * textureWidth + state.clipX0 + x, color);
+        }
+    }
+
+    void DrawPolyline(RenderState &state, const int32_t *vertices, uint32_t count, uint8_t colorIndex, bool closed)
+    {
+        if (count == 1)
+            DrawPixel(state, vertices[0], vertices[1], colorIndex);
+
+        for (uint32_t i = 1; i < count; i++)
+            DrawLine(state, vertices[i * 2 - 2], vertices[i * 2 - 1], vertices[i * 2], vertices[i * 2 + 1], colorIndex);
+
+        if (closed && count > 2)
+            DrawLine(state, vertices[count * 2 - 2], vertices[count * 2 - 1], vertices[0], vertices[1], colorIndex);
+    }
+
+    void DrawRects(RenderState &state, const int32_t *rects, uint32_t count, uint8_t colorIndex, bool filled)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const int32_t *rect = rects + i * 4;
+            DrawRect(state, rect[0], rect[1], rect[2], rect[3], colorIndex, filled);
+        }
+    }
+
+    void CopyRect(RenderState &state, int x0, int y0, int x1, int y1, int dx, int dy)
+    {
+        y0 = std::max(y0, state.bandY0);
+        y1 = std::min(y1, state.bandY1);
+        if (y0 > y1 || x0 > x1)
+            return;
+
+        size_t rowSize = (x1 - x0 + 1) * sizeof(uint32_t);
+
+        // moving down, the rows are copied bottom up so every source row is read before it is overwritten
+        int step = dy > 0 ? -1 : 1;
+        int first = dy > 0 ? y1 : y0;
+        int count = y1 - y0 + 1;
+
+        for (int i = 0, y = first; i < count; i++, y += step)
+        {
+            uint32_t *destination = state.target + y * textureWidth + x0;
+            memmove(destination, destination - dy * (int)textureWidth - dx, rowSize);
+        }
+    }
+
+    void SetClipping(RenderState &state, int x0, int y0, int x1, int y1)
+    {
+        // The rasterizers write the frame buffer without bounds checks, so the clipping rectangle must stay inside it.
+        // It is kept inside the screen too, in the low resolution modes nothing is drawn outside of it.
+        int bottom = std::min(state.bandY1, state.screenHeight - 1);
+        state.clipX0 = std::clamp(x0, 0, state.screenWidth - 1);
+        state.clipY0 = std::clamp(y0, state.bandY0, bottom);
+        state.clipX1 = std::clamp(x1, 0, state.screenWidth - 1);
+        state.clipY1 = std::clamp(y1, state.bandY0, bottom);
+
+        // the clamped rectangle may end up empty when it is outside of the screen or the band
+        if (x0 > state.screenWidth - 1)
+            state.clipX0 = state.screenWidth;
+        if (x1 < 0)
+            state.clipX1 = -1;
+        if (y0 > bottom)
+            state.clipY0 = bottom + 1;
+        if (y1 < state.bandY0)
+            state.clipY1 = state.bandY0 - 1;
+    }
+
+    void DisableClipping(RenderState &state)
+    {
+        SetClipping(state, 0, 0, state.screenWidth - 1, state.screenHeight - 1);
+    }
+
+    void SetVideoMode(RenderState &state, uint8_t videoMode)
+    {
+        const VideoModeInfo &info = GetVideoModeInfo(videoMode);
+        state.videoMode = videoMode;
+        state.screenWidth = info.width;
+        state.screenHeight = info.height;
+        DisableClipping(state);
+    }
+
+    void DrawTileLayers(RenderState &state, const MMU::TileLayerRegisters *layers, const MMU::AffineLayerRegisters *affineLayers, const uint8_t *order, int count)
+    {
+        uint8_t coverage[textureWidth];
+
+        for (int y = state.bandY0; y <= state.bandY1; y++)
+            DrawTileLayerRow(state, layers, affineLayers, order, count, y, coverage);
+    }
+
+    // What an affine layer samples: a bitmap, or a map of tiles with a power of two sizes fast path.
+    struct AffineSource
+    {
+        const uint8_t *bitmap = nullptr; // nullptr for a tile map
+        const uint8_t *map = nullptr;
+        const uint8_t *tiles = nullptr;
+        uint32_t tileBankSize = 0; // bytes from tiles to the end of the tile memory
+        int width = 0;             // in pixels
+        int height = 0;
+        int mapWidth = 0;
+        int tileWidth = 0;
+        int tileHeight = 0;
+        bool wrap = false;
+    };
+
+    bool GetAffineSource(const RenderState &state, const MMU::TileLayerRegisters &layer, const MMU::AffineLayerRegisters &affine, AffineSource &source)
+    {
+        source.wrap = layer.flags & MMU::TILE_LAYER_WRAP;
+
+        if (layer.flags & MMU::TILE_LAYER_BITMAP)
+        {
+            source.width = affine.bitmapWidth;
+            source.height = affine.bitmapHeight;
+            if ((uint64_t)affine.bitmapOffset + (uint64_t)source.width * source.height > bitmapMemorySize)
+                return false;
+
+            source.bitmap = state.bitmap + affine.bitmapOffset;
+        }
+        else
+        {
+            if (layer.mapOffset + layer.mapWidth * layer.mapHeight > (int)mapMemorySize || layer.tileOffset >= tileMemorySize)
+                return false;
+
+            source.map = state.map + layer.mapOffset;
+            source.tiles = state.tiles + layer.tileOffset;
+            source.tileBankSize = tileMemorySize - layer.tileOffset;
+            source.mapWidth = layer.mapWidth;
+            source.tileWidth = layer.tileWidth;
+            source.tileHeight = layer.tileHeight;
+            source.width = layer.mapWidth * layer.tileWidth;
+            source.height = layer.mapHeight * layer.tileHeight;
+        }
+
+        return source.width != 0 && source.height != 0;
+    }
+
+    // Returns the color index of the layer pixel (x, y), or -1 outside of a layer that doesn't wrap.
+    inline int SampleAffineSource(const AffineSource &source, int64_t x, int64_t y)
+    {
+        if (source.wrap)
+        {
+            x = ((x % source.width) + source.width) % source.width;
+            y = ((y % source.height) + source.height) % source.height;
+        }
+        else if (x < 0 || y < 0 || x >= source.width || y >= source.height)
+            return -1;
+
+        if (source.bitmap != nullptr)
+            return source.bitmap[y * source.width + x];
+
+        int tileIndex = source.map[(y / source.tileHeight) * source.mapWidth + x / source.tileWidth];
+        uint32_t offset = (tileIndex * source.tileHeight + y % source.tileHeight) * source.tileWidth + x % source.tileWidth;
+        return offset < source.tileBankSize ? source.tiles[offset] : -1;
+    }
+
+#ifdef RETROSIM_AVX2
+    inline bool IsPowerOfTwo(int value) { return (value & (value - 1)) == 0; }
+
+    inline int Log2(int value)
+    {
+        int log = 0;
+        while ((1 << log) < value)
+            log++;
+        return log;
+    }
+
+    // Eight pixels at a time for wrapping layers with power of two sizes, where the coordinates wrap with a mask.
+    // The 16.16 coordinates are stepped in 32 bits: the mask only keeps bits the overflow doesn't change. The
+    // map, the tiles and the palette are read with gathers, which read 4 bytes from every byte address. These
+    // stay inside the memory, which always goes on after the map, the tile and the bitmap memories.
+    // Returns the number of pixels drawn, 0 if the layer doesn't qualify.
+    RETROSIM_AVX2_FUNCTION int DrawAffineRowAVX2(const RenderState &state, const AffineSource &source, const MMU::AffineLayerRegisters &affine, int64_t u, int64_t v, int transparentColorIndex, uint32_t *pixel, uint8_t *coverage, int &uncovered)
+    {
+        if (!source.wrap || !IsPowerOfTwo(source.width) || !IsPowerOfTwo(source.height))
+            return 0;
+
+        bool bitmap = source.bitmap != nullptr;
+        if (!bitmap && (!IsPowerOfTwo(source.tileWidth) || !IsPowerOfTwo(source.tileHeight) || 256u * source.tileWidth * source.tileHeight > source.tileBankSize))
+            return 0;
+
+        const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i x = _mm256_add_epi32(_mm256_set1_epi32((int32_t)(uint32_t)u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(affine.a)));
+        __m256i y = _mm256_add_epi32(_mm256_set1_epi32((int32_t)(uint32_t)v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(affine.c)));
+        const __m256i stepX = _mm256_set1_epi32((int32_t)((uint32_t)affine.a * 8u));
+        const __m256i stepY = _mm256_set1_epi32((int32_t)((uint32_t)affine.c * 8u));
+        const __m256i widthMask = _mm256_set1_epi32(source.width - 1);
+        const __m256i heightMask = _mm256_set1_epi32(source.height - 1);
+        const __m256i byteMask = _mm256_set1_epi32(0xFF);
+        const __m256i transparent = _mm256_set1_epi32(transparentColorIndex);
+
+        const __m128i widthShift = _mm_cvtsi32_si128(Log2(source.width));
+        const __m128i tileWidthShift = _mm_cvtsi32_si128(Log2(std::max(source.tileWidth, 1)));
+        const __m128i tileHeightShift = _mm_cvtsi32_si128(Log2(std::max(source.tileHeight, 1)));
+        const __m128i mapWidthShift = _mm_cvtsi32_si128(Log2(std::max(source.mapWidth, 1)));
+        const __m128i tileSizeShift = _mm_cvtsi32_si128(Log2(std::max(source.tileWidth * source.tileHeight, 1)));
+        const __m256i tileWidthMask = _mm256_set1_epi32(source.tileWidth - 1);
+        const __m256i tileHeightMask = _mm256_set1_epi32(source.tileHeight - 1);
+
+        const int count = state.screenWidth / 8 * 8;
+        for (int i = 0; i < count; i += 8)
+        {
+            __m256i sampleX = _mm256_and_si256(_mm256_srai_epi32(x, 16), widthMask);
+            __m256i sampleY = _mm256_and_si256(_mm256_srai_epi32(y, 16), heightMask);
+            x = _mm256_add_epi32(x, stepX);
+            y = _mm256_add_epi32(y, stepY);
+
+            __m256i colorIndex;
+            if (bitmap)
+            {
+                __m256i offset = _mm256_add_epi32(_mm256_sll_epi32(sampleY, widthShift), sampleX);
+                colorIndex = _mm256_and_si256(_mm256_i32gather_epi32((const int *)source.bitmap, offset, 1), byteMask);
+            }
+            else
+            {
+                __m256i mapOffset = _mm256_add_epi32(_mm256_sll_epi32(_mm256_srl_epi32(sampleY, tileHeightShift), mapWidthShift), _mm256_srl_epi32(sampleX, tileWidthShift));
+                __m256i tileIndex = _mm256_and_si256(_mm256_i32gather_epi32((const int *)source.map, mapOffset, 1), byteMask);
+                __m256i tileOffset = _mm256_add_epi32(_mm256_sll_epi32(tileIndex, tileSizeShift),
+                                                      _mm256_add_epi32(_mm256_sll_epi32(_mm256_and_si256(sampleY, tileHeightMask), tileWidthShift), _mm256_and_si256(sampleX, tileWidthMask)));
+                colorIndex = _mm256_and_si256(_mm256_i32gather_epi32((const int *)source.tiles, tileOffset, 1), byteMask);
+            }
+
+            // drawn where the pixel isn't transparent and no layer in front covers it
+            __m256i covered = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(coverage + i)));
+            __m256i skip = _mm256_or_si256(_mm256_cmpeq_epi32(colorIndex, transparent), _mm256_cmpgt_epi32(covered, _mm256_setzero_si256()));
+            int skipMask = _mm256_movemask_ps(_mm256_castsi256_ps(skip));
+            if (skipMask == 0xFF)
+                continue;
+
+            __m256i color = _mm256_i32gather_epi32((const int *)state.palette, colorIndex, 4);
+            _mm256_maskstore_epi32((int *)(pixel + i), _mm256_xor_si256(skip, _mm256_set1_epi32(-1)), color);
+
+            for (int j = 0; j < 8; j++)
+            {
+                if (!(skipMask & (1 << j)))
+                {
+                    coverage[i + j] = 1;
+                    uncovered--;
+                }
+            }
+        }
+
+        return count;
+    }
+#endif
+
+    // The layer coordinates are stepped across the row in 16.16 fixed point.
+    void DrawAffineLayerRow(RenderState &state, const MMU::TileLayerRegisters &layer, const MMU::AffineLayerRegisters &affine, int y, uint8_t *coverage, int &uncovered)
+    {
+        AffineSource source;
+        if (!GetAffineSource(state, layer, affine, source))
+            return;
+
+        uint32_t *pixel = state.target + y * textureWidth;
+        int transparentColorIndex = (layer.flags & MMU::TILE_LAYER_TRANSPARENT) ? layer.transparentColorIndex : -1;
+        int64_t u = (int64_t)affine.originX + (int64_t)y * affine.b;
+        int64_t v = (int64_t)affine.originY + (int64_t)y * affine.d;
+        int x = 0;
+
+#ifdef RETROSIM_AVX2
+        if (HasAVX2())
+        {
+            x = DrawAffineRowAVX2(state, source, affine, u, v, transparentColorIndex, pixel, coverage, uncovered);
+            u += (int64_t)x * affine.a;
+            v += (int64_t)x * affine.c;
+        }
+#endif
+
+        for (; x < state.screenWidth; x++, u += affine.a, v += affine.c)
+        {
+            if (coverage[x])
+                continue;
+
+            int colorIndex = SampleAffineSource(source, u >> 16, v >> 16);
+            if (colorIndex < 0 || colorIndex == transparentColorIndex)
+                continue;
+
+            pixel[x] = state.palette[colorIndex];
+            coverage[x] = 1;
+            uncovered--;
+        }
+    }
+
+    // The layers are walked front to back. Each of them only fills the pixels the layers in front left
+    // transparent, and the row is done as soon as every pixel is covered.
+    void DrawTileLayerRow(RenderState &state, const MMU::TileLayerRegisters *layers, const MMU::AffineLayerRegisters *affineLayers, const uint8_t *order, int count, int y, uint8_t *coverage)
+    {
+        uint32_t *pixel = state.target + y * textureWidth;
+        int uncovered = state.screenWidth;
+        memset(coverage, 0, state.screenWidth);
+
+        for (int i = 0; i < count && uncovered > 0; i++)
+        {
+            const MMU::TileLayerRegisters &layer = layers[order[i]];
+            if (layer.flags & MMU::TILE_LAYER_AFFINE)
+            {
+                DrawAffineLayerRow(state, layer, affineLayers[order[i]], y, coverage, uncovered);
+                continue;
+            }
+
+            bool wrap = layer.flags & MMU::TILE_LAYER_WRAP;
+            int transparentColorIndex = (layer.flags & MMU::TILE_LAYER_TRANSPARENT) ? layer.transparentColorIndex : -1;
+            int tileWidth = layer.tileWidth;
+            int tileHeight = layer.tileHeight;
+            int mapPixelWidth = layer.mapWidth * tileWidth;
+            int mapPixelHeight = layer.mapHeight * tileHeight;
+
+            int mapY = y + layer.scrollY;
+            if (wrap)
+                mapY = ((mapY % mapPixelHeight) + mapPixelHeight) % mapPixelHeight;
+            else if (mapY < 0 || mapY >= mapPixelHeight)
+                continue;
+
+            uint32_t mapRowOffset = layer.mapOffset + (mapY / tileHeight) * layer.mapWidth;
+            if (mapRowOffset + layer.mapWidth > mapMemorySize)
+                continue;
+
+            const uint8_t *mapRow = state.map + mapRowOffset;
+            int tileSize = tileWidth * tileHeight;
+            int tileRowOffset = (mapY % tileHeight) * tileWidth;
+
+            int x0 = 0;
+            int x1 = state.screenWidth - 1;
+            if (!wrap)
+            {
+                x0 = std::max(x0, -layer.scrollX);
+                x1 = std::min(x1, mapPixelWidth - 1 - layer.scrollX);
+            }
+
+            int mapX = x0 + layer.scrollX;
+            if (wrap)
+                mapX = ((mapX % mapPixelWidth) + mapPixelWidth) % mapPixelWidth;
+
+            // a tile at a time, the map and the tile bank are looked up once per tile
+            for (int x = x0; x <= x1;)
+            {
+                int columnInTile = mapX % tileWidth;
+                int run = std::min(tileWidth - columnInTile, x1 - x + 1);
+                uint32_t tileOffset = layer.tileOffset + mapRow[mapX / tileWidth] * tileSize + tileRowOffset;
+
+                if (tileOffset + tileWidth <= tileMemorySize)
+                {
+                    const uint8_t *source = state.tiles + tileOffset + columnInTile;
+                    for (int j = 0; j < run; j++)
+                    {
+                        int colorIndex = source[j];
+                        if (coverage[x + j] || colorIndex == transparentColorIndex)
+                            continue;
+                        pixel[x + j] = state.palette[colorIndex];
+                        coverage[x + j] = 1;
+                        uncovered--;
+                    }
+                }
+
+                x += run;
+                mapX += run;
+                if (mapX >= mapPixelWidth)
+                    mapX = 0;
+            }
+        }
+    }
+
+    void DrawTextLayer(RenderState &state, const uint8_t *redrawCells, int fontHeight, uint8_t backgroundColorIndex)
+    {
+        const int cellWidth = TextLayer::cellWidth;
+        const uint8_t *font = state.charset + TextLayer::GetFontOffset(fontHeight);
+        uint32_t backgroundColor = state.palette[backgroundColorIndex];
+
+        // the cells of the screen, the rows of TEXT_SCREEN stay TextLayer::columns long in every mode
+        int rows = state.screenHeight / fontHeight;
+        int columns = state.screenWidth / cellWidth;
+        int firstRow = state.bandY0 / fontHeight;
+        int lastRow = std::min(state.bandY1 / fontHeight, rows - 1);
+
+        for (int row = firstRow; row <= lastRow; row++)
+        {
+            // the part of the row inside the band
+            int firstY = std::max(row * fontHeight, state.bandY0) - row * fontHeight;
+            int lastY = std::min(row * fontHeight + fontHeight - 1, state.bandY1) - row * fontHeight;
+
+            for (int column = 0; column < columns; column++)
+            {
+                int i = row * TextLayer::columns + column;
+                if (!redrawCells[i])
+                    continue;
+
+                const uint8_t *glyph = font + state.textScreen[i] * fontHeight;
+                uint32_t color = state.palette[state.textColors[i]];
+                uint32_t *pixel = state.target + row * fontHeight * textureWidth + column * cellWidth;
+
+                for (int y = firstY; y <= lastY; y++)
+                    ExpandGlyphByte(pixel + y * textureWidth, glyphMaskTable.masks[glyph[y]], 0, cellWidth - 1, color, backgroundColor, true);
+            }
+        }
+    }
+
+    void DrawSpriteRow(RenderState &state, const MMU::SpriteAttributes &sprite, int y, uint8_t atlasPitch, uint8_t *coverage)
+    {
+        int row = y - sprite.y;
+        if (sprite.flags & MMU::SPRITE_FLIP_Y)
+            row = sprite.height - 1 - row;
+
+        uint32_t sourceOffset = (sprite.atlasY + row) * atlasPitch + sprite.atlasX;
+        if (sourceOffset + sprite.width > spriteAtlasSize)
+            return;
+
+        const uint8_t *source = state.spriteAtlas + sourceOffset;
+        uint32_t *pixel = state.target + y * textureWidth;
+        int x0 = std::max((int)sprite.x, 0);
+        int x1 = std::min(sprite.x + sprite.width - 1, state.screenWidth - 1);
+        bool flipX = sprite.flags & MMU::SPRITE_FLIP_X;
+        int transparentColorIndex = (sprite.flags & MMU::SPRITE_TRANSPARENT) ? sprite.transparentColorIndex : -1;
+
+        for (int x = x0; x <= x1; x++)
+        {
+            int column = flipX ? sprite.x + sprite.width - 1 - x : x - sprite.x;
+            int colorIndex = source[column];
+            if (colorIndex == transparentColorIndex)
+                continue;
+            pixel[x] = state.palette[colorIndex];
+            if (coverage != nullptr)
+                coverage[x] = 1;
+        }
+    }
+
+    void DrawSpriteLayer(RenderState &state, const SpriteEngine &sprites, uint8_t atlasPitch)
+    {
+        for (int y = state.bandY0; y <= state.bandY1; y++)
+        {
+            int count;
+            const uint8_t *scanline = sprites.GetScanline(y, count);
+
+            for (int i = 0; i < count; i++)
+                DrawSpriteRow(state, sprites.GetSprite(scanline[i]), y, atlasPitch, nullptr);
+        }
+    }
+
+    void DrawFramebuffer(RenderState &state, const uint8_t *rows)
+    {
+        const VideoModeInfo &info = GetVideoModeInfo(state.videoMode);
+        const uint8_t *rowBits = rows;
+        const uint8_t *source = rows + textureHeight / 8;
+        uint32_t palette[256];
+        if (info.bytesPerPixel == 1)
+        {
+            memcpy(palette, source, sizeof(palette));
+            ConvertPalette(palette, palette, state.outputFormat);
+            source += sizeof(palette);
+        }
+        // where the red and blue channels of the RGB565 pixels go
+        int redShift = state.outputFormat == OUTPUT_ARGB8888 ? 16 : 0;
+        int blueShift = 16 - redShift;
+
+        int lastY = std::min(state.bandY1, (int)info.height - 1);
+
+        for (int y = 0; y <= lastY; y++)
+        {
+            if (!(rowBits[y / 8] & (1 << (y % 8))))
+                continue;
+
+            if (y >= state.bandY0)
+            {
+                uint32_t *pixel = state.target + y * textureWidth;
+                if (info.bytesPerPixel == 1)
+                {
+                    for (int x = 0; x < info.width; x++)
+                        pixel[x] = palette[source[x]];
+                }
+                else
+                {
+                    // little endian RGB565, the 5 and 6 bit channels are widened by repeating their top bits
+                    for (int x = 0; x < info.width; x++)
+                    {
+                        uint32_t color = source[2 * x] | (source[2 * x + 1] << 8);
+                        uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+                        pixel[x] = 0xFF000000 | (b << 3 | b >> 2) << blueShift | (g << 2 | g >> 4) << 8 | (r << 3 | r >> 2) << redShift;
+                    }
+                }
+            }
+
+            source += info.width * info.bytesPerPixel;
+        }
+    }
+
+    void SetBand(RenderState &state, int y0, int y1)
+    {
+        state.bandY0 = y0;
+        state.bandY1 = y1;
+        state.clipY0 = std::max(state.clipY0, y0);
+        state.clipY1 = std::min(state.clipY1, y1);
+    }
+
+    void DrawTile(RenderState &state, int tileScreenX, int tileScreenY, const TileCache::Tile &tile, int tileWidth, int firstX, int firstY, int lastX, int lastY)
+    {
+        for (int tileMemY = firstY; tileMemY <= lastY; tileMemY++)
+        {
+            int rowOffset = tileMemY * tileWidth;
+            uint32_t *pixel = state.target + (tileScreenY + tileMemY) * textureWidth + tileScreenX;
+
+            if (tile.rowOpaque[tileMemY])
+            {
+                memcpy(pixel + firstX, tile.pixels + rowOffset + firstX, (lastX - firstX + 1) * sizeof(uint32_t));
+                continue;
+            }
+
+            for (int tileMemX = firstX; tileMemX <= lastX; tileMemX++)
+                if (tile.opaque[rowOffset + tileMemX])
+                    pixel[tileMemX] = tile.pixels[rowOffset + tileMemX];
+        }
+    }
+
+    // Tiles are read from the tile memory. Map entries and tiles outside of their memory sections are skipped.
+    void DrawMap(RenderState &state, int screenX, int screenY, int mapX, int mapY, int width, int height, int16_t transparentColorIndex, uint8_t tileWidth, uint8_t tileHeight, uint8_t mapWidth)
+    {
+        int tileSize = tileWidth * tileHeight;
+        // the cached tiles are copied as they are, blending and the stencil go pixel by pixel
+        bool cached = state.tileCache != nullptr && tileSize <= TileCache::maxTilePixels && state.blendMode == BLEND_NONE && state.stencilMode == STENCIL_OFF;
+
+        for (int tileY = mapY; tileY < mapY + height; tileY++)
+        {
+            for (int tileX = mapX; tileX < mapX + width; tileX++)
+            {
+                int tileScreenX = screenX + (tileX - mapX) * tileWidth;
+                int tileScreenY = screenY + (tileY - mapY) * tileHeight;
+
+                int firstX, firstY, lastX, lastY;
+                if (!ClipRect(state, tileScreenX, tileScreenY, tileWidth, tileHeight, firstX, firstY, lastX, lastY))
+                    continue;
+
+                int64_t mapOffset = tileX + (int64_t)tileY * mapWidth;
+                if (mapOffset < 0 || mapOffset >= mapMemorySize)
+                    continue;
+
+                int tileIndex = state.map[mapOffset];
+                int tileOffset = tileIndex * tileSize;
+                if (tileOffset + tileSize > (int)tileMemorySize)
+                    continue;
+
+                if (cached)
+                {
+                    const TileCache::Tile &tile = state.tileCache->Get(state.tiles, state.palette, state.paletteVersion, tileIndex, tileWidth, tileHeight, transparentColorIndex);
+                    DrawTile(state, tileScreenX, tileScreenY, tile, tileWidth, firstX, firstY, lastX, lastY);
+                    continue;
+                }
+
+                for (int tileMemY = firstY; tileMemY <= lastY; tileMemY++)
+                {
+                    const uint8_t *source = state.tiles + tileOffset + tileMemY * tileWidth;
+                    uint32_t *pixel = state.target + (tileScreenY + tileMemY) * textureWidth + tileScreenX;
+
+                    for (int tileMemX = firstX; tileMemX <= lastX; tileMemX++)
+                    {
+                        int colorIndex = source[tileMemX];
+                        if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
+                            continue;
+                        PutPixel(state, pixel + tileMemX, state.palette[colorIndex]);
+                    }
+                }
+            }
+        }
+    }
+
+    void DrawSprite(RenderState &state, int screenPosX, int screenPosY, int spritePosX, int spritePosY, int width, int height, int16_t transparentColorIndex, uint8_t pitch)
+    {
+        int firstX, firstY, lastX, lastY;
+        if (!ClipRect(state, screenPosX, screenPosY, width, height, firstX, firstY, lastX, lastY))
+            return;
+
+        for (int y = firstY; y <= lastY; y++)
+        {
+            const uint8_t *source = state.spriteAtlas + spritePosX + (spritePosY + y) * pitch;
+            uint32_t *pixel = state.target + (screenPosY + y) * textureWidth + screenPosX;
+
+            for (int x = firstX; x <= lastX; x++)
+            {
+                int colorIndex = source[x];
+                if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
+                    continue;
+                PutPixel(state, pixel + x, state.palette[colorIndex]);
+            }
+        }
+    }
+
+    inline int64_t FloorDiv(int64_t a, int64_t b) { return a / b - (a % b != 0 && (a < 0) != (b < 0)); }
+    inline int64_t CeilDiv(int64_t a, int64_t b) { return -FloorDiv(-a, b); }
+
+    // Narrows the steps [first, last] to those for which start + step * t is in [0, limit).
+    void ClipSampleRange(int64_t start, int64_t step, int64_t limit, int64_t &first, int64_t &last)
+    {
+        if (step == 0)
+        {
+            if (start < 0 || start >= limit)
+                last = first - 1;
+        }
+        else if (step > 0)
+        {
+            first = std::max(first, CeilDiv(-start, step));
+            last = std::min(last, FloorDiv(limit - 1 - start, step));
+        }
+        else
+        {
+            first = std::max(first, CeilDiv(start - limit + 1, -step));
+            last = std::min(last, FloorDiv(start, -step));
+        }
+    }
+
+#ifdef RETROSIM_AVX2
+    // Eight pixels at a time, the atlas and the palette are read with gathers. Every sample of the row is inside the sprite,
+    // so the 16.16 coordinates fit in 32 bits. The gathers read 4 bytes from every byte address, which stay in the memory
+    // as the GPU registers follow the sprite atlas. Returns the number of pixels drawn.
+    RETROSIM_AVX2_FUNCTION int DrawTransformedSpriteRowAVX2(const RenderState &state, const uint8_t *sprite, int pitch, int64_t u, int64_t v, int32_t stepU, int32_t stepV, int count, int transparentColorIndex, uint32_t *pixel)
+    {
+        const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i x = _mm256_add_epi32(_mm256_set1_epi32((int32_t)u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(stepU)));
+        __m256i y = _mm256_add_epi32(_mm256_set1_epi32((int32_t)v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(stepV)));
+        const __m256i stepX = _mm256_set1_epi32((int32_t)((uint32_t)stepU * 8u));
+        const __m256i stepY = _mm256_set1_epi32((int32_t)((uint32_t)stepV * 8u));
+        const __m256i pitchVector = _mm256_set1_epi32(pitch);
+        const __m256i byteMask = _mm256_set1_epi32(0xFF);
+        const __m256i transparent = _mm256_set1_epi32(transparentColorIndex);
+
+        int drawn = count / 8 * 8;
+        for (int i = 0; i < drawn; i += 8)
+        {
+            __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(y, 16), pitchVector), _mm256_srai_epi32(x, 16));
+            x = _mm256_add_epi32(x, stepX);
+            y = _mm256_add_epi32(y, stepY);
+
+            __m256i colorIndex = _mm256_and_si256(_mm256_i32gather_epi32((const int *)sprite, offset, 1), byteMask);
+            __m256i skip = _mm256_cmpeq_epi32(colorIndex, transparent);
+            if (_mm256_movemask_ps(_mm256_castsi256_ps(skip)) == 0xFF)
+                continue;
+
+            __m256i color = _mm256_i32gather_epi32((const int *)state.palette, colorIndex, 4);
+            _mm256_maskstore_epi32((int *)(pixel + i), _mm256_xor_si256(skip, _mm256_set1_epi32(-1)), color);
+        }
+
+        return drawn;
+    }
+#endif
+
+    // Every row is walked from the first to the last pixel that maps into the sprite, found by solving the
+    // linear sample coordinates for the sprite's edges, so no pixel outside of the sprite is visited.
+    void DrawTransformedSprite(RenderState &state, int centerX, int centerY, int spriteX, int spriteY, int width, int height, const int32_t matrix[4], int left, int top, int right, int bottom, int16_t transparentColorIndex, uint8_t pitch)
+    {
+        if (width <= 0 || height <= 0 || spriteX < 0 || spriteY < 0 ||
+            (int64_t)(spriteY + (int64_t)height - 1) * pitch + spriteX + width > spriteAtlasSize)
+            return;
+
+        const uint8_t *sprite = state.spriteAtlas + spriteY * pitch + spriteX;
+        int64_t a = matrix[0], b = matrix[1], c = matrix[2], d = matrix[3];
+        int64_t limitU = (int64_t)width << 16;
+        int64_t limitV = (int64_t)height << 16;
+
+        int x0 = std::max(left, state.clipX0);
+        int x1 = std::min(right, state.clipX1);
+        int y0 = std::max(top, state.clipY0);
+        int y1 = std::min(bottom, state.clipY1);
+
+        for (int y = y0; y <= y1 && x0 <= x1; y++)
+        {
+            // twice the distance of the first pixel's center from the sprite's center
+            int64_t dx = 2 * ((int64_t)x0 - centerX) + 1;
+            int64_t dy = 2 * ((int64_t)y - centerY) + 1;
+            int64_t u = (limitU >> 1) + ((a * dx + b * dy) >> 1);
+            int64_t v = (limitV >> 1) + ((c * dx + d * dy) >> 1);
+
+            int64_t first = 0;
+            int64_t last = x1 - x0;
+            ClipSampleRange(u, a, limitU, first, last);
+            ClipSampleRange(v, c, limitV, first, last);
+            if (first > last)
+                continue;
+
+            u += a * first;
+            v += c * first;
+            uint32_t *pixel = state.target + y * textureWidth + x0 + first;
+            int count = (int)(last - first + 1);
+            int i = 0;
+
+#ifdef RETROSIM_AVX2
+            if (HasAVX2() && state.blendMode == BLEND_NONE && state.stencilMode == STENCIL_OFF)
+            {
+                i = DrawTransformedSpriteRowAVX2(state, sprite, pitch, u, v, (int32_t)a, (int32_t)c, count, transparentColorIndex, pixel);
+                u += a * i;
+                v += c * i;
+            }
+#endif
+
+            for (; i < count; i++, u += a, v += c)
+            {
+                int colorIndex = sprite[(v >> 16) * pitch + (u >> 16)];
+                if (colorIndex == transparentColorIndex)
+                    continue;
+                PutPixel(state, pixel + i, state.palette[colorIndex]);
+            }
+        }
+    }
+
+    void DrawBitmap(RenderState &state, int screenPosX, int screenPosY, int bitmapPosX, int bitmapPosY, int width, int height, int pitch, int16_t transparentColorIndex)
+    {
+        int firstX, firstY, lastX, lastY;
+        if (!ClipRect(state, screenPosX, screenPosY, width, height, firstX, firstY, lastX, lastY))
+            return;
+
+        for (int y = firstY; y <= lastY; y++)
+        {
+            const uint8_t *source = state.bitmap + bitmapPosX + (bitmapPosY + y) * pitch;
+            uint32_t *pixel = state.target + (screenPosY + y) * textureWidth + screenPosX;
+
+            for (int x = firstX; x <= lastX; x++)
+            {
+                int colorIndex = source[x];
+                if (transparentColorIndex != -1 && colorIndex == transparentColorIndex)
+                    continue;
+                PutPixel(state, pixel + x, state.palette[colorIndex]);
+            }
+        }
+    }
+}
@@ -0,0 +1,172 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+#include "TileCache.h"
+#include "TextLayer.h"
+#include "SpriteEngine.h"
+
+namespace RetroSim::GPU::Rasterizer
+{
+    // The stencil has a bit for every pixel, bit x % 64 of word x / 64 of the row. The rows start at a word, so the bands
+    // never share one.
+    const int stencilRowWords = (textureWidth + 63) / 64;
+
+    // Scratch memory of FloodFill() and FillPolygon(). It is allocated up front and reused, it only grows when a fill
+    // needs more than it ever did before. Fills running in parallel need their own.
+    struct FillBuffers
+    {
+        // filled pixels [left, right] of row y whose neighbours in row y + dy haven't been looked at yet
+        struct Span
+        {
+            int y;
+            int left;
+            int right;
+            int dy;
+        };
+
+        // a polygon edge from (x0, y0) to (x0 + dx, y0 + dy), it crosses the centers of rows [firstRow, lastRow]
+        struct Edge
+        {
+            int firstRow;
+            int lastRow;
+            double x0;
+            double y0;
+            double dx;
+            double dy;
+            double crossing; // x where it crosses the center of the current row
+        };
+
+        std::vector<Span> spans;        // the stack of the flood fill
+        std::vector<Edge> edges;        // the edge table, sorted by the edges' first row
+        std::vector<Edge> activeEdges;  // the edges crossing the current row, sorted by their crossings
+
+        FillBuffers()
+        {
+            spans.reserve(4096);
+            edges.reserve(256);
+            activeEdges.reserve(256);
+        }
+    };
+
+    // Everything a rasterizer needs. The command buffer owns one of these and updates it
+    // while replaying state changing commands (clipping, font, palette, blend mode).
+    struct RenderState
+    {
+        uint32_t *target = nullptr; // textureWidth * textureHeight pixels in outputFormat
+        uint8_t outputFormat = OUTPUT_ABGR8888; // OutputFormat of palette and target
+
+        // the video mode and the part of the frame buffer it shows
+        uint8_t videoMode = VIDEO_MODE_464X256;
+        int screenWidth = textureWidth;
+        int screenHeight = textureHeight;
+
+        // clipping rectangle, inclusive and always inside the screen
+        int clipX0 = 0;
+        int clipY0 = 0;
+        int clipX1 = textureWidth - 1;
+        int clipY1 = textureHeight - 1;
+
+        // rows this state renders to, inclusive. The clipping rectangle is always kept inside the band,
+        // so several threads can render disjoint bands of the same frame.
+        int bandY0 = 0;
+        int bandY1 = textureHeight - 1;
+
+        // for print()
+        uint8_t fontWidth = 8;
+        uint8_t fontHeight = 16;
+        uint32_t fontOffset = 0; // byte offset of the font in CHARSET, the glyphs are stored as 1bpp rows
+
+        uint8_t blendMode = BLEND_NONE; // BlendMode
+        uint8_t stencilMode = STENCIL_OFF; // StencilMode
+        uint64_t *stencil = nullptr;       // textureHeight rows of stencilRowWords words, required unless the stencil is off
+
+        uint32_t palette[256] = {};
+        // Identifies the contents of the palette for the tile cache. Every palette change moves to the
+        // next version, which the command buffer reserves for the frame, so bands replaying the same
+        // commands agree on the versions.
+        uint64_t paletteVersion = 0;
+        uint64_t nextPaletteVersion = 1;
+
+        // memory sections the rasterizers read from, laid out as in the MMU. The command buffer points
+        // these to the copy of the memory taken when the frame was submitted.
+        const uint8_t *map = nullptr;
+        const uint8_t *tiles = nullptr;
+        const uint8_t *spriteAtlas = nullptr;
+        const uint8_t *bitmap = nullptr;
+        const uint8_t *charset = nullptr;
+        const uint8_t *textScreen = nullptr;
+        const uint8_t *textColors = nullptr;
+
+        // expanded tiles for DrawMap, optional
+        TileCache *tileCache = nullptr;
+        // required by the fills
+        FillBuffers *fillBuffers = nullptr;
+    };
+
+    // Palette colors are stored with red in the lowest byte, these give them in the channel order of the output.
+    inline uint32_t ConvertColor(uint32_t color, uint8_t outputFormat)
+    {
+        if (outputFormat != OUTPUT_ARGB8888)
+            return color;
+        return (color & 0xFF00FF00) | (color & 0xFF) << 16 | (color >> 16 & 0xFF);
+    }
+    void ConvertPalette(uint32_t *destination, const uint32_t *palette, uint8_t outputFormat);
+
+    void SetFont(RenderState &state, int width, int height, int offset);
+    // color is stored like the palette colors
+    void SetPaletteColor(RenderState &state, uint8_t index, uint32_t color);
+    void RenderText(RenderState &state, const char *text, uint32_t length, int x, int y, uint8_t colorIndex);
+    void RenderOpaqueText(RenderState &state, const char *text, uint32_t length, int x, int y, uint8_t colorIndex, uint8_t backgroundColorIndex);
+    void ClearScreen(RenderState &state, uint8_t colorIndex);
+    void ClearScreenIgnoreClipping(RenderState &state, uint8_t colorIndex);
+    void DrawPixel(RenderState &state, int x, int y, uint8_t colorIndex);
+    void DrawLine(RenderState &state, int x0, int y0, int x1, int y1, uint8_t colorIndex);
+    void DrawRect(RenderState &state, int x, int y, int width, int height, uint8_t colorIndex, bool filled);
+    // The batches draw the same pixels as the single primitives, see GPU.h for the layout of the coordinates.
+    void DrawPixels(RenderState &state, const int32_t *points, uint32_t count, uint8_t colorIndex);
+    void DrawPolyline(RenderState &state, const int32_t *vertices, uint32_t count, uint8_t colorIndex, bool closed);
+    void DrawRects(RenderState &state, const int32_t *rects, uint32_t count, uint8_t colorIndex, bool filled);
+    void DrawCircle(RenderState &state, int x, int y, int radius, uint8_t colorIndex, bool filled);
+    // Scanline seed fill of the pixels connected to (x, y) that have its color, inside the clipping rectangle. The fill has to
+    // see the rows it reaches, so it runs on a state that covers the whole frame. It replaces the pixels regardless of the blend mode.
+    void FloodFill(RenderState &state, int x, int y, uint8_t colorIndex);
+    // Fills the spans between pairs of edge crossings of every row's center, with an active edge table.
+    void FillPolygon(RenderState &state, const int32_t *vertices, uint32_t count, uint8_t colorIndex);
+    void DrawTriangle(RenderState &state, int x0, int y0, int x1, int y1, int x2, int y2, uint8_t colorIndex, bool filled);
+    void DrawMap(RenderState &state, int screenX, int screenY, int mapX, int mapY, int width, int height, int16_t transparentColorIndex, uint8_t tileWidth, uint8_t tileHeight, uint8_t mapWidth);
+    void DrawSprite(RenderState &state, int x, int y, int spritex, int spritey, int width, int height, int16_t transparentColorIndex, uint8_t pitch);
+    // Draws a sprite through the screen to atlas transformation matrix, in 16.16 fixed point: the pixel (x, y) shows the atlas
+    // pixel (width / 2 + a * dx + b * dy, height / 2 + c * dx + d * dy) of the sprite, where (dx, dy) is the pixel's center
+    // relative to (centerX, centerY). Only the pixels of [left, right] x [top, bottom] that map into the sprite are visited.
+    void DrawTransformedSprite(RenderState &state, int centerX, int centerY, int spriteX, int spriteY, int width, int height, const int32_t matrix[4], int left, int top, int right, int bottom, int16_t transparentColorIndex, uint8_t pitch);
+    void DrawBitmap(RenderState &state, int screenPosX, int screenPosY, int bitmapPosX, int bitmapPosY, int width, int height, int pitch, int16_t transparentColorIndex);
+    void SetClipping(RenderState &state, int x0, int y0, int x1, int y1);
+    void DisableClipping(RenderState &state);
+    // Switches to the screen of the video mode and resets the clipping rectangle to it.
+    void SetVideoMode(RenderState &state, uint8_t videoMode);
+    void SetBlendMode(RenderState &state, uint8_t mode);
+    void SetStencilMode(RenderState &state, uint8_t mode);
+    // Sets or clears the stencil bits of the clipping rectangle.
+    void ClearStencil(RenderState &state, bool value);
+    // Copies the pixels (x - dx, y - dy) to the rectangle [x0, x1] x [y0, y1] of the target, which has to be inside it and
+    // so does the source. Only the rows of the band are written, the source rows are read wherever they are.
+    void CopyRect(RenderState &state, int x0, int y0, int x1, int y1, int dx, int dy);
+    // Composes the given tile layers front to back, see TileLayerCompositor. It isn't affected by clipping.
+    void DrawTileLayers(RenderState &state, const MMU::TileLayerRegisters *layers, const MMU::AffineLayerRegisters *affineLayers, const uint8_t *order, int count);
+    // Composes row y of the tile layers. coverage is a row of textureWidth bytes, its first screenWidth bytes are set to 1 where a
+    // layer drew the pixel and to 0 elsewhere.
+    void DrawTileLayerRow(RenderState &state, const MMU::TileLayerRegisters *layers, const MMU::AffineLayerRegisters *affineLayers, const uint8_t *order, int count, int y, uint8_t *coverage);
+    // Draws the given cells of the text layer, see TextLayer. It isn't affected by clipping.
+    void DrawTextLayer(RenderState &state, const uint8_t *redrawCells, int fontHeight, uint8_t backgroundColorIndex);
+    // Draws the sprites selected by the engine from the sprite atlas. It isn't affected by clipping.
+    void DrawSpriteLayer(RenderState &state, const SpriteEngine &sprites, uint8_t atlasPitch);
+    // Draws the changed rows of the guest framebuffer, see DrawFramebufferCommand for the layout. It isn't affected by clipping.
+    void DrawFramebuffer(RenderState &state, const uint8_t *rows);
+    // Draws row y of a sprite, which has to cover the row. Where coverage isn't nullptr, it is set to 1 for the drawn pixels of the row.
+    void DrawSpriteRow(RenderState &state, const MMU::SpriteAttributes &sprite, int y, uint8_t atlasPitch, uint8_t *coverage);
+    void SetBand(RenderState &state, int y0, int y1);
+}
@@ -0,0 +1,138 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "ScanlineLayer.h"
+#include "MMU.h"
+#include "TextLayer.h"
+#include "SpriteEngine.h"
+#include "TileLayerCompositor.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    ScanlineLayer::ScanlineLayer()
+        : pixels(pixelCount), coverage(pixelCount), allCells(TextLayer::columns * TextLayer::maxRows, 1)
+    {
+        lineSprites.reserve(MMU::spriteCount);
+        Clear();
+    }
+
+    void ScanlineLayer::Clear()
+    {
+        std::fill_n(left, textureHeight, (int16_t)textureWidth);
+        std::fill_n(right, textureHeight, (int16_t)-1);
+        lineCount = 0;
+    }
+
+    void ScanlineLayer::RenderLine(int y, uint8_t videoMode)
+    {
+        if (videoMode != state.videoMode)
+            Rasterizer::SetVideoMode(state, videoMode);
+        if (y < 0 || y >= state.screenHeight)
+            return;
+
+        const MMU::GPURegisters &registers = MMU::memory.gpu;
+        int screenWidth = state.screenWidth;
+        uint8_t *lineCoverage = coverage.data() + y * textureWidth;
+        int x0 = textureWidth;
+        int x1 = -1;
+
+        memset(lineCoverage, 0, screenWidth);
+        lineCount++;
+
+        int tileLayerCount = TileLayerCompositor::SortLayers(MMU::memory.tileLayers, tileLayerOrder);
+
+        if (tileLayerCount == 0 && registers.textMode == 0 && registers.spriteMode == 0)
+        {
+            left[y] = (int16_t)x0;
+            right[y] = (int16_t)x1;
+            return;
+        }
+
+        // the layers read the live memory, the CPU is stopped while the line is composed
+        state.target = pixels.data();
+        Rasterizer::ConvertPalette(state.palette, MMU::memory.Palette_u32, state.outputFormat);
+        state.map = MMU::memory.Map_u8;
+        state.tiles = MMU::memory.Tiles_u8;
+        state.bitmap = MMU::memory.Bitmap_u8;
+        state.charset = MMU::memory.Charset_u8;
+        state.textScreen = MMU::memory.TextScreen_u8;
+        state.textColors = MMU::memory.TextColor_u8;
+        state.spriteAtlas = MMU::memory.SpriteAtlas_u8;
+        Rasterizer::DisableClipping(state);
+        Rasterizer::SetBand(state, y, y);
+
+        if (tileLayerCount != 0)
+        {
+            Rasterizer::DrawTileLayerRow(state, MMU::memory.tileLayers, MMU::memory.affineLayers, tileLayerOrder, tileLayerCount, y, lineCoverage);
+            for (int x = 0; x < screenWidth; x++)
+            {
+                if (lineCoverage[x])
+                {
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x);
+                }
+            }
+        }
+
+        if (registers.textMode != 0)
+        {
+            int fontHeight = registers.textFontHeight == 8 ? 8 : 16;
+            if (y / fontHeight < state.screenHeight / fontHeight)
+            {
+                Rasterizer::DrawTextLayer(state, allCells.data(), fontHeight, registers.textBackgroundColor);
+                x0 = 0;
+                x1 = screenWidth / TextLayer::cellWidth * TextLayer::cellWidth - 1;
+                memset(lineCoverage, 1, x1 + 1);
+            }
+        }
+
+        if (registers.spriteMode != 0)
+        {
+            // the attribute table can change between lines, so the sprites are selected for every line
+            const MMU::SpriteAttributes *sprites = MMU::memory.spriteAttributes;
+            lineSprites.clear();
+            for (int i = 0; i < MMU::spriteCount; i++)
+                if (SpriteEngine::IsOnScreen(sprites[i], screenWidth, state.screenHeight) && y >= sprites[i].y && y < sprites[i].y + sprites[i].height)
+                    lineSprites.push_back((uint8_t)i);
+
+            std::stable_sort(lineSprites.begin(), lineSprites.end(), [sprites](uint8_t a, uint8_t b)
+            {
+                return SpriteEngine::IsDrawnBefore(sprites, a, b);
+            });
+
+            for (uint8_t index : lineSprites)
+            {
+                const MMU::SpriteAttributes &sprite = sprites[index];
+                Rasterizer::DrawSpriteRow(state, sprite, y, registers.spriteAtlasPitch, lineCoverage);
+                x0 = std::min(x0, std::max((int)sprite.x, 0));
+                x1 = std::max(x1, std::min(sprite.x + sprite.width - 1, screenWidth - 1));
+            }
+        }
+
+        left[y] = (int16_t)x0;
+        right[y] = (int16_t)x1;
+    }
+
+    void ScanlineLayer::Cover(OverlayBackground &background) const
+    {
+        for (int y = 0; y < (int)textureHeight; y++)
+            if (left[y] <= right[y])
+                background.Cover(y, left[y], right[y]);
+    }
+
+    void ScanlineLayer::Draw(uint32_t *target, int y0, int y1) const
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            const uint32_t *source = pixels.data() + y * textureWidth;
+            const uint8_t *lineCoverage = coverage.data() + y * textureWidth;
+            uint32_t *pixel = target + y * textureWidth;
+
+            for (int x = left[y]; x <= right[y]; x++)
+                if (lineCoverage[x])
+                    pixel[x] = source[x];
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+#include "MMU.h"
+#include "Rasterizer.h"
+#include "OverlayBackground.h"
+
+namespace RetroSim::GPU
+{
+    // In scanline mode the tile, text and sprite layers are composed a line at a time on the CPU thread, between the
+    // CPU's lines. Every line is drawn with the registers, the palette and the memory as they are when the line
+    // is reached, so the CPU can change them from the raster IRQ in the middle of the frame. The composed lines
+    // are handed to the render thread with the frame and drawn on top of the frame's commands.
+    class ScanlineLayer
+    {
+    public:
+        ScanlineLayer();
+
+        // Starts a new frame without any lines.
+        void Clear();
+        // Composes line y of the video mode's screen from the current contents of the memory.
+        void RenderLine(int y, uint8_t videoMode);
+        void SetOutputFormat(uint8_t outputFormat) { state.outputFormat = outputFormat; }
+        // true if no line was composed in the frame
+        bool IsEmpty() const { return lineCount == 0; }
+
+        // Adds the pixels the layer covers to background.
+        void Cover(OverlayBackground &background) const;
+        // Draws the covered pixels of the rows [y0, y1] to target.
+        void Draw(uint32_t *target, int y0, int y1) const;
+
+    private:
+        std::vector<uint32_t> pixels;
+        std::vector<uint8_t> coverage; // 1 where a layer drew the pixel
+        // the covered columns of each row, empty when left > right
+        int16_t left[textureHeight];
+        int16_t right[textureHeight];
+        int lineCount = 0;
+
+        Rasterizer::RenderState state;
+        uint8_t tileLayerOrder[MMU::tileLayerCount];
+        std::vector<uint8_t> allCells;    // every cell of the text layer is drawn
+        std::vector<uint8_t> lineSprites; // the sprites covering the line, in drawing order
+    };
+}
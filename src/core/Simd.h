@@ -0,0 +1,39 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+
+// SSE2 is part of x86-64, its code paths need no check at runtime.
+#if defined(__SSE2__) || defined(_M_X64)
+#define RETROSIM_SSE2
+#include <emmintrin.h>
+#endif
+
+// The AVX2 code paths. With GCC and Clang they are compiled in for x86-64 even without -mavx2, through the target
+// attribute, so they have to be guarded with HasAVX2() at runtime.
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(__AVX2__)
+#define RETROSIM_AVX2
+#define RETROSIM_AVX2_FUNCTION
+#elif defined(__GNUC__) || defined(__clang__)
+#define RETROSIM_AVX2
+#define RETROSIM_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef RETROSIM_AVX2
+#include <immintrin.h>
+
+namespace RetroSim
+{
+    inline bool HasAVX2()
+    {
+#if defined(__AVX2__)
+        return true;
+#else
+        static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+        return hasAVX2;
+#endif
+    }
+}
+#endif
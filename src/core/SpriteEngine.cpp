@@ -0,0 +1,88 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "SpriteEngine.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    SpriteEngine::SpriteEngine()
+        : scanlineStart(textureHeight + 1, 0)
+    {
+        drawOrder.reserve(MMU::spriteCount);
+    }
+
+    void SpriteEngine::Invalidate()
+    {
+        Clear();
+        background.Invalidate();
+    }
+
+    void SpriteEngine::Clear()
+    {
+        std::fill(scanlineStart.begin(), scanlineStart.end(), 0);
+    }
+
+    bool SpriteEngine::IsOnScreen(const MMU::SpriteAttributes &sprite, int screenWidth, int screenHeight)
+    {
+        return (sprite.flags & MMU::SPRITE_ENABLED) && sprite.width != 0 && sprite.height != 0 &&
+               sprite.x + sprite.width > 0 && sprite.x < screenWidth &&
+               sprite.y + sprite.height > 0 && sprite.y < screenHeight;
+    }
+
+    void SpriteEngine::Prepare(const uint8_t *memory, int screenWidth, int screenHeight, DirtyRegion &dirtyRegion)
+    {
+        background.BeginFrame();
+        Clear();
+
+        if (memory != nullptr)
+        {
+            memcpy(sprites, memory + MMU::SPRITE_ATTRIBUTES, sizeof(sprites));
+
+            // off-screen and disabled sprites are rejected here, the rest is sorted back to front
+            drawOrder.clear();
+            for (int i = 0; i < MMU::spriteCount; i++)
+                if (IsOnScreen(sprites[i], screenWidth, screenHeight))
+                    drawOrder.push_back((uint8_t)i);
+
+            std::stable_sort(drawOrder.begin(), drawOrder.end(), [this](uint8_t a, uint8_t b)
+            {
+                return IsDrawnBefore(sprites, a, b);
+            });
+
+            // per-scanline lists: count the sprites of every row, then fill them in drawing order
+            for (uint8_t index : drawOrder)
+            {
+                const MMU::SpriteAttributes &sprite = sprites[index];
+                int y0 = std::max((int)sprite.y, 0);
+                int y1 = std::min(sprite.y + sprite.height - 1, screenHeight - 1);
+                int x0 = std::max((int)sprite.x, 0);
+                int x1 = std::min(sprite.x + sprite.width - 1, screenWidth - 1);
+
+                for (int y = y0; y <= y1; y++)
+                {
+                    scanlineStart[y + 1]++;
+                    background.Cover(y, x0, x1);
+                }
+            }
+
+            for (int y = 0; y < (int)textureHeight; y++)
+                scanlineStart[y + 1] += scanlineStart[y];
+
+            scanlineSprites.resize(scanlineStart[textureHeight]);
+            nextEntry.assign(scanlineStart.begin(), scanlineStart.end() - 1);
+            for (uint8_t index : drawOrder)
+            {
+                const MMU::SpriteAttributes &sprite = sprites[index];
+                int y0 = std::max((int)sprite.y, 0);
+                int y1 = std::min(sprite.y + sprite.height - 1, screenHeight - 1);
+
+                for (int y = y0; y <= y1; y++)
+                    scanlineSprites[nextEntry[y]++] = index;
+            }
+        }
+
+        background.MarkDirty(dirtyRegion);
+    }
+}
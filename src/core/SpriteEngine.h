@@ -0,0 +1,65 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+#include "MMU.h"
+#include "DirtyRegion.h"
+#include "OverlayBackground.h"
+
+namespace RetroSim::GPU
+{
+    // Composes the sprite attribute table on top of the frame. The sprites aren't part of the persistent output:
+    // the pixels under them are saved before they are drawn and restored at the start of the next frame,
+    // so moving a sprite doesn't leave a trail behind.
+    class SpriteEngine
+    {
+    public:
+        SpriteEngine();
+
+        // Collects the sprites visible on the screenWidth x screenHeight screen from the attribute table in memory, or
+        // none if memory is nullptr, and sorts them into per-scanline lists in drawing order. Both the previous and the
+        // new sprite rows are added to dirtyRegion. Has to be called before the frame is drawn.
+        void Prepare(const uint8_t *memory, int screenWidth, int screenHeight, DirtyRegion &dirtyRegion);
+
+        // Puts back the pixels under the sprites of the previous frame, in the rows [y0, y1].
+        void RestoreBackground(uint32_t *target, int y0, int y1) const { background.Restore(target, y0, y1); }
+        // Saves the pixels the sprites of the frame are about to cover, in the rows [y0, y1].
+        void SaveBackground(const uint32_t *target, int y0, int y1) { background.Save(target, y0, y1); }
+
+        // the sprites covering row y, back to front
+        const uint8_t *GetScanline(int y, int &count) const
+        {
+            count = scanlineStart[y + 1] - scanlineStart[y];
+            return scanlineSprites.data() + scanlineStart[y];
+        }
+        const MMU::SpriteAttributes &GetSprite(int index) const { return sprites[index]; }
+
+        // true if sprites are on the screen, even a frame without commands has to remove them
+        bool IsVisible() const { return background.IsVisible(); }
+        // The output was cleared, there are no sprites on it to remove.
+        void Invalidate();
+
+        // false for disabled sprites and sprites entirely off the screen
+        static bool IsOnScreen(const MMU::SpriteAttributes &sprite, int screenWidth, int screenHeight);
+        // The drawing order: lower priorities first, within a priority the lower index ends up on top.
+        static bool IsDrawnBefore(const MMU::SpriteAttributes *sprites, uint8_t a, uint8_t b)
+        {
+            int priorityA = sprites[a].flags & MMU::SPRITE_PRIORITY_MASK;
+            int priorityB = sprites[b].flags & MMU::SPRITE_PRIORITY_MASK;
+            return priorityA != priorityB ? priorityA < priorityB : a > b;
+        }
+
+    private:
+        MMU::SpriteAttributes sprites[MMU::spriteCount];
+        std::vector<uint8_t> drawOrder;
+        std::vector<uint32_t> scanlineStart; // index of each row's first entry in scanlineSprites
+        std::vector<uint8_t> scanlineSprites;
+        std::vector<uint32_t> nextEntry;
+        OverlayBackground background;
+
+        void Clear();
+    };
+}
@@ -0,0 +1,78 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "TextLayer.h"
+#include "MMU.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    TextLayer::TextLayer()
+        : characters(columns * maxRows), colors(columns * maxRows), glyphs(256 * 16), redrawCells(columns * maxRows)
+    {
+    }
+
+    void TextLayer::Prepare(const uint8_t *memory, int screenWidth, int screenHeight, int newFontHeight, uint8_t newBackgroundColorIndex, const uint32_t *newPalette, DirtyRegion &dirtyRegion)
+    {
+        const uint8_t *newCharacters = memory + MMU::TEXT_SCREEN_U8;
+        const uint8_t *newColors = memory + MMU::TEXT_COLOR_U8;
+        const uint8_t *newGlyphs = memory + MMU::CHARSET_U8 + GetFontOffset(newFontHeight);
+        size_t glyphsSize = 256 * newFontHeight;
+
+        // anything that affects every cell
+        bool redrawAll = !valid ||
+                         newFontHeight != fontHeight ||
+                         newBackgroundColorIndex != backgroundColorIndex ||
+                         memcmp(newPalette, palette, sizeof(palette)) != 0 ||
+                         memcmp(newGlyphs, glyphs.data(), glyphsSize) != 0;
+
+        if (redrawAll)
+        {
+            fontHeight = newFontHeight;
+            backgroundColorIndex = newBackgroundColorIndex;
+            memcpy(palette, newPalette, sizeof(palette));
+            memcpy(glyphs.data(), newGlyphs, glyphsSize);
+            valid = true;
+        }
+
+        int rows = screenHeight / fontHeight;
+        int screenColumns = screenWidth / cellWidth;
+        for (int row = 0; row < rows; row++)
+        {
+            int y0 = row * fontHeight;
+            int y1 = y0 + fontHeight - 1;
+
+            // columns drawn over by the commands in the cells' rows, read before the row's cells are added
+            int dirtyX0, dirtyX1;
+            if (!dirtyRegion.GetColumns(y0, y1, dirtyX0, dirtyX1))
+                dirtyX0 = dirtyX1 = -cellWidth;
+            int firstDirtyColumn = dirtyX0 / cellWidth;
+            int lastDirtyColumn = dirtyX1 / cellWidth;
+
+            int firstRedrawn = screenColumns;
+            int lastRedrawn = -1;
+
+            for (int column = 0; column < screenColumns; column++)
+            {
+                int i = row * columns + column;
+                bool redraw = redrawAll ||
+                              (column >= firstDirtyColumn && column <= lastDirtyColumn) ||
+                              newCharacters[i] != characters[i] ||
+                              newColors[i] != colors[i];
+
+                redrawCells[i] = redraw;
+                if (redraw)
+                {
+                    characters[i] = newCharacters[i];
+                    colors[i] = newColors[i];
+                    firstRedrawn = std::min(firstRedrawn, column);
+                    lastRedrawn = column;
+                }
+            }
+
+            if (firstRedrawn <= lastRedrawn)
+                dirtyRegion.Mark(firstRedrawn * cellWidth, y0, lastRedrawn * cellWidth + cellWidth - 1, y1);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GPU.h"
+#include "DirtyRegion.h"
+
+namespace RetroSim::GPU
+{
+    // The character cell text layer: TEXT_SCREEN holds a character code and TEXT_COLOR a foreground color index
+    // for every cell, row by row. The layer covers the screen and is drawn on top of the frame's commands.
+    // Since the output persists between frames, only the cells that changed since they were last drawn,
+    // or that the frame's commands drew over, have to be drawn again.
+    class TextLayer
+    {
+    public:
+        static const int cellWidth = 8;
+        static const int columns = textureWidth / cellWidth; // in memory, the low resolution modes show the left half of every row
+        static const int maxRows = textureHeight / 8;
+
+        // the fonts set up by Core::InitializeFonts(), 1bpp rows
+        static uint32_t GetFontOffset(int fontHeight) { return fontHeight == 8 ? 0x8000 : 0; }
+
+        TextLayer();
+
+        // Selects the cells of the screenWidth x screenHeight screen to draw in the frame. On entry dirtyRegion is the part of
+        // the screen the frame's commands draw to, the selected cells are added to it. palette is the palette at the end of
+        // the frame. Has to be called before the frame is drawn.
+        void Prepare(const uint8_t *memory, int screenWidth, int screenHeight, int fontHeight, uint8_t backgroundColorIndex, const uint32_t *palette, DirtyRegion &dirtyRegion);
+        // one byte per cell, nonzero for the cells selected by Prepare()
+        const uint8_t *GetRedrawCells() const { return redrawCells.data(); }
+        // The output no longer contains the layer, e.g. a frame without it was drawn. Every cell is drawn next time.
+        void Invalidate() { valid = false; }
+
+    private:
+        // the layer as it was last drawn
+        std::vector<uint8_t> characters;
+        std::vector<uint8_t> colors;
+        std::vector<uint8_t> glyphs;
+        uint32_t palette[256] = {};
+        int fontHeight = 0;
+        uint8_t backgroundColorIndex = 0;
+        bool valid = false;
+
+        std::vector<uint8_t> redrawCells;
+    };
+}
@@ -0,0 +1,114 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "TileCache.h"
+#include "MMU.h"
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    const uint32_t tileMemorySize = MMU::SPRITE_ATLAS_U8 - MMU::TILES_U8;
+
+    TileMemoryTracker::TileMemoryTracker()
+        : tiles(tileMemorySize, 0), blockChangedFrame(tileMemorySize / blockSize, 0)
+    {
+    }
+
+    void TileMemoryTracker::Update(const uint8_t *newTiles)
+    {
+        frame++;
+
+        for (uint32_t block = 0; block < blockChangedFrame.size(); block++)
+        {
+            uint32_t offset = block * blockSize;
+            if (memcmp(tiles.data() + offset, newTiles + offset, blockSize) != 0)
+            {
+                memcpy(tiles.data() + offset, newTiles + offset, blockSize);
+                blockChangedFrame[block] = frame;
+            }
+        }
+    }
+
+    bool TileMemoryTracker::IsUnchangedSince(uint32_t offset, uint32_t size, uint32_t sinceFrame) const
+    {
+        for (uint32_t block = offset / blockSize; block <= (offset + size - 1) / blockSize; block++)
+            if (blockChangedFrame[block] > sinceFrame)
+                return false;
+
+        return true;
+    }
+
+    TileCache::TileCache(const TileMemoryTracker &tracker)
+        : tracker(tracker), tiles(capacity), entries(capacity)
+    {
+        lookup.reserve(capacity);
+    }
+
+    const TileCache::Tile &TileCache::Get(const uint8_t *tileMemory, const uint32_t *palette, uint64_t paletteVersion, uint8_t tileIndex, uint8_t tileWidth, uint8_t tileHeight, int16_t transparentColorIndex)
+    {
+        Key key = {paletteVersion, (uint32_t)(tileIndex | tileWidth << 8 | tileHeight << 16), transparentColorIndex};
+        uint32_t tileSize = tileWidth * tileHeight;
+        uint32_t offset = tileIndex * tileSize;
+
+        int slot;
+        auto found = lookup.find(key);
+        if (found != lookup.end())
+        {
+            slot = found->second;
+            if (tracker.IsUnchangedSince(offset, tileSize, entries[slot].builtInFrame))
+            {
+                entries[slot].lastUsed = ++useCounter;
+                return tiles[slot];
+            }
+        }
+        else
+        {
+            slot = FindLeastRecentlyUsed();
+            if (entries[slot].used)
+                lookup.erase(entries[slot].key);
+
+            entries[slot].key = key;
+            entries[slot].used = true;
+            lookup[key] = slot;
+        }
+
+        Expand(tiles[slot], tileMemory + offset, palette, tileWidth, tileHeight, transparentColorIndex);
+        entries[slot].builtInFrame = tracker.GetFrame();
+        entries[slot].lastUsed = ++useCounter;
+
+        return tiles[slot];
+    }
+
+    int TileCache::FindLeastRecentlyUsed()
+    {
+        int leastRecentlyUsed = 0;
+        for (int i = 0; i < capacity; i++)
+        {
+            if (!entries[i].used)
+                return i;
+            if (entries[i].lastUsed < entries[leastRecentlyUsed].lastUsed)
+                leastRecentlyUsed = i;
+        }
+
+        return leastRecentlyUsed;
+    }
+
+    void TileCache::Expand(Tile &tile, const uint8_t *source, const uint32_t *palette, uint8_t tileWidth, uint8_t tileHeight, int16_t transparentColorIndex)
+    {
+        for (int y = 0; y < tileHeight; y++)
+        {
+            bool rowOpaque = true;
+            for (int x = 0; x < tileWidth; x++)
+            {
+                int i = y * tileWidth + x;
+                uint8_t colorIndex = source[i];
+                bool opaque = transparentColorIndex == -1 || colorIndex != transparentColorIndex;
+
+                tile.pixels[i] = palette[colorIndex];
+                tile.opaque[i] = opaque;
+                rowOpaque = rowOpaque && opaque;
+            }
+            tile.rowOpaque[y] = rowOpaque;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace RetroSim::GPU
+{
+    // Keeps a copy of the tile memory and remembers in which frame each 64 byte block of it last changed.
+    class TileMemoryTracker
+    {
+    public:
+        TileMemoryTracker();
+
+        // Compares the tile memory of a new frame with the previous one. Has to be called before the frame is drawn.
+        void Update(const uint8_t *tiles);
+        uint32_t GetFrame() const { return frame; }
+        // true if the given bytes of the tile memory haven't changed after the given frame
+        bool IsUnchangedSince(uint32_t offset, uint32_t size, uint32_t sinceFrame) const;
+
+    private:
+        static const uint32_t blockSize = 64;
+
+        std::vector<uint8_t> tiles;
+        std::vector<uint32_t> blockChangedFrame;
+        uint32_t frame = 0;
+    };
+
+    // Tiles expanded to ARGB pixels with the palette they were drawn with. Every rendering band owns a cache,
+    // so the caches are never shared between threads. Only tiles up to maxTilePixels are cached.
+    class TileCache
+    {
+    public:
+        static const int maxTilePixels = 256; // e.g. 8x16 or 16x16
+        static const int capacity = 128;      // the whole tile memory in 8x16 tiles
+
+        struct Tile
+        {
+            uint32_t pixels[maxTilePixels];
+            uint8_t opaque[maxTilePixels]; // 0 where the pixel has the transparent color
+            bool rowOpaque[maxTilePixels]; // every pixel of the row is opaque, the row can be copied as is
+        };
+
+        TileCache(const TileMemoryTracker &tracker);
+
+        // Returns the tile expanded with the given palette. The palette version identifies the palette's
+        // contents, the tile is expanded again when either the palette or the tile memory changed.
+        const Tile &Get(const uint8_t *tiles, const uint32_t *palette, uint64_t paletteVersion, uint8_t tileIndex, uint8_t tileWidth, uint8_t tileHeight, int16_t transparentColorIndex);
+
+    private:
+        struct Key
+        {
+            uint64_t paletteVersion;
+            uint32_t tile; // index, width and height
+            int32_t transparentColorIndex;
+
+            bool operator==(const Key &other) const
+            {
+                return paletteVersion == other.paletteVersion && tile == other.tile && transparentColorIndex == other.transparentColorIndex;
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const
+            {
+                return (size_t)(key.paletteVersion * 0x9e3779b97f4a7c15ull) ^ key.tile ^ ((size_t)key.transparentColorIndex << 24);
+            }
+        };
+
+        struct Entry
+        {
+            Key key;
+            uint32_t builtInFrame; // tile memory frame the pixels were expanded from
+            uint64_t lastUsed;
+            bool used = false;
+        };
+
+        const TileMemoryTracker &tracker;
+        std::vector<Tile> tiles;
+        std::vector<Entry> entries;
+        std::unordered_map<Key, int, KeyHash> lookup;
+        uint64_t useCounter = 0;
+
+        int FindLeastRecentlyUsed();
+        void Expand(Tile &tile, const uint8_t *source, const uint32_t *palette, uint8_t tileWidth, uint8_t tileHeight, int16_t transparentColorIndex);
+    };
+}
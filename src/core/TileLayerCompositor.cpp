@@ -0,0 +1,75 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "TileLayerCompositor.h"
+#include <algorithm>
+#include <cstring>
+
+namespace RetroSim::GPU
+{
+    void TileLayerCompositor::Invalidate()
+    {
+        layerCount = 0;
+        background.Invalidate();
+    }
+
+    int TileLayerCompositor::SortLayers(const MMU::TileLayerRegisters *layers, uint8_t *order)
+    {
+        int count = 0;
+        for (int i = 0; i < MMU::tileLayerCount; i++)
+        {
+            const MMU::TileLayerRegisters &layer = layers[i];
+            if ((layer.flags & MMU::TILE_LAYER_ENABLED) && layer.mapWidth != 0 && layer.mapHeight != 0 && layer.tileWidth != 0 && layer.tileHeight != 0)
+                order[count++] = (uint8_t)i;
+        }
+
+        std::stable_sort(order, order + count, [layers](uint8_t a, uint8_t b)
+        {
+            return layers[a].priority > layers[b].priority;
+        });
+
+        return count;
+    }
+
+    bool TileLayerCompositor::GetScreenRect(const MMU::TileLayerRegisters &layer, int screenWidth, int screenHeight, int &x0, int &y0, int &x1, int &y1)
+    {
+        x0 = 0;
+        y0 = 0;
+        x1 = screenWidth - 1;
+        y1 = screenHeight - 1;
+
+        // the affine layers aren't bounded, a rotated layer can reach any pixel
+        if (layer.flags & (MMU::TILE_LAYER_WRAP | MMU::TILE_LAYER_AFFINE))
+            return true;
+
+        x0 = std::max(x0, -layer.scrollX);
+        y0 = std::max(y0, -layer.scrollY);
+        x1 = std::min(x1, layer.mapWidth * layer.tileWidth - 1 - layer.scrollX);
+        y1 = std::min(y1, layer.mapHeight * layer.tileHeight - 1 - layer.scrollY);
+
+        return x0 <= x1 && y0 <= y1;
+    }
+
+    void TileLayerCompositor::Prepare(const uint8_t *memory, int screenWidth, int screenHeight, DirtyRegion &dirtyRegion)
+    {
+        background.BeginFrame();
+        layerCount = 0;
+
+        if (memory != nullptr)
+        {
+            memcpy(layers, memory + MMU::TILE_LAYERS, sizeof(layers));
+            memcpy(affineLayers, memory + MMU::TILE_LAYERS + sizeof(layers), sizeof(affineLayers));
+            layerCount = SortLayers(layers, order);
+
+            for (int i = 0; i < layerCount; i++)
+            {
+                int x0, y0, x1, y1;
+                if (GetScreenRect(layers[order[i]], screenWidth, screenHeight, x0, y0, x1, y1))
+                    for (int y = y0; y <= y1; y++)
+                        background.Cover(y, x0, x1);
+            }
+        }
+
+        background.MarkDirty(dirtyRegion);
+    }
+}
@@ -0,0 +1,54 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+#include "GPU.h"
+#include "MMU.h"
+#include "DirtyRegion.h"
+#include "OverlayBackground.h"
+
+namespace RetroSim::GPU
+{
+    // Composes the tile layers on top of the frame, below the text layer and the sprites. Every row is written
+    // once: the layers are merged front to back and a pixel is done as soon as a layer has an opaque pixel there.
+    // Like the sprites, the layers aren't part of the persistent output, so they can scroll without leaving a trail.
+    class TileLayerCompositor
+    {
+    public:
+        // Reads the layer registers from memory, or no layers if memory is nullptr. The rows of the screenWidth x screenHeight
+        // screen covered by the previous and the new layers are added to dirtyRegion. Has to be called before the frame is drawn.
+        void Prepare(const uint8_t *memory, int screenWidth, int screenHeight, DirtyRegion &dirtyRegion);
+
+        // Puts back the pixels under the layers of the previous frame, in the rows [y0, y1].
+        void RestoreBackground(uint32_t *target, int y0, int y1) const { background.Restore(target, y0, y1); }
+        // Saves the pixels the layers of the frame are about to cover, in the rows [y0, y1].
+        void SaveBackground(const uint32_t *target, int y0, int y1) { background.Save(target, y0, y1); }
+
+        const MMU::TileLayerRegisters *GetLayers() const { return layers; }
+        const MMU::AffineLayerRegisters *GetAffineLayers() const { return affineLayers; }
+        // the enabled layers, front to back
+        const uint8_t *GetOrder(int &count) const
+        {
+            count = layerCount;
+            return order;
+        }
+
+        bool IsVisible() const { return background.IsVisible(); }
+        // The output was cleared, there are no layers on it to remove.
+        void Invalidate();
+
+        // Puts the indices of the enabled layers into order, front to back, and returns their count.
+        static int SortLayers(const MMU::TileLayerRegisters *layers, uint8_t *order);
+        // The screen rectangle the layer can draw to, inclusive. Returns false if it draws nothing.
+        static bool GetScreenRect(const MMU::TileLayerRegisters &layer, int screenWidth, int screenHeight, int &x0, int &y0, int &x1, int &y1);
+
+    private:
+        MMU::TileLayerRegisters layers[MMU::tileLayerCount] = {};
+        MMU::AffineLayerRegisters affineLayers[MMU::tileLayerCount] = {};
+        uint8_t order[MMU::tileLayerCount] = {};
+        int layerCount = 0;
+
+        OverlayBackground background;
+    };
+}
@@ -0,0 +1,98 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "TripleBuffer.h"
+#include <cstring>
+#include <new>
+
+namespace RetroSim::GPU
+{
+    TripleBuffer::TripleBuffer(size_t pixelCount)
+        : pixelCount(pixelCount), ready(1)
+    {
+        // Aligned to cache lines, so a frame can be split among threads along cache line boundaries.
+        for (uint32_t *&buffer : buffers)
+            buffer = new (std::align_val_t(64)) uint32_t[pixelCount];
+
+        Clear();
+    }
+
+    TripleBuffer::~TripleBuffer()
+    {
+        for (uint32_t *buffer : buffers)
+            operator delete[](buffer, std::align_val_t(64));
+    }
+
+    uint32_t *TripleBuffer::GetWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // After Publish() the producer no longer owns this buffer, but nobody writes it until it is published over,
+    // so the producer can still read it, e.g. to draw the next frame on top of it.
+    const uint32_t *TripleBuffer::GetLastPublishedBuffer()
+    {
+        return buffers[lastPublishedIndex];
+    }
+
+    void TripleBuffer::Publish(const DirtyRegion &changed, uint8_t videoMode)
+    {
+        // The consumer may still hold any frame published since the last one it is known to have taken,
+        // so the region has to cover all changes since then.
+        unseenChanges.Add(changed);
+        dirtyRegions[writeIndex] = unseenChanges;
+        videoModes[writeIndex] = videoMode;
+
+        // release: the consumer has to see the pixels; acquire: the buffer we get back may have just been read by the consumer
+        uint32_t previous = ready.exchange(writeIndex | newFrameFlag, std::memory_order_acq_rel);
+        lastPublishedIndex = writeIndex;
+        writeIndex = previous & indexMask;
+
+        // The previous frame was taken by the consumer, from now on only the changes made after it count.
+        if ((previous & newFrameFlag) == 0)
+            unseenChanges = changed;
+    }
+
+    bool TripleBuffer::Acquire()
+    {
+        if ((ready.load(std::memory_order_relaxed) & newFrameFlag) == 0)
+            return false;
+
+        uint32_t previous = ready.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+
+        return true;
+    }
+
+    const uint32_t *TripleBuffer::GetReadBuffer()
+    {
+        return buffers[readIndex];
+    }
+
+    const DirtyRegion &TripleBuffer::GetReadDirtyRegion()
+    {
+        return dirtyRegions[readIndex];
+    }
+
+    uint8_t TripleBuffer::GetReadVideoMode()
+    {
+        return videoModes[readIndex];
+    }
+
+    void TripleBuffer::Clear()
+    {
+        for (uint32_t *buffer : buffers)
+            memset(buffer, 0, pixelCount * sizeof(uint32_t));
+
+        // the consumer's copy is in an unknown state
+        for (DirtyRegion &dirtyRegion : dirtyRegions)
+            dirtyRegion.MarkAll();
+        unseenChanges.MarkAll();
+        memset(videoModes, VIDEO_MODE_464X256, sizeof(videoModes));
+
+        writeIndex = 0;
+        lastPublishedIndex = 1;
+        readIndex = 2;
+        ready.store(lastPublishedIndex | newFrameFlag, std::memory_order_release);
+    }
+}
@@ -0,0 +1,56 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "DirtyRegion.h"
+
+namespace RetroSim::GPU
+{
+    // Three frame buffers shared by one producer (the renderer) and one consumer (the frontend).
+    // The producer draws into its write buffer and publishes it by swapping it with the ready buffer,
+    // the consumer takes the ready buffer by swapping it with its read buffer. Both swaps are a single
+    // atomic exchange, so neither side ever waits for the other and the consumer never sees a frame
+    // that is being drawn. Every published buffer carries the region that changed since the frame the
+    // consumer acquired before it, so the consumer can update only that part of its copy, and the video
+    // mode it was drawn in.
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer(size_t pixelCount);
+        ~TripleBuffer();
+
+        // producer side
+        uint32_t *GetWriteBuffer();
+        const uint32_t *GetLastPublishedBuffer(); // stays readable by the producer until the next Publish()
+        void Publish(const DirtyRegion &changed, uint8_t videoMode); // changed: the region drawn since the previous Publish()
+
+        // Consumer side. Acquire() returns true if a newer frame was published since the last call,
+        // the read buffer stays valid until the next Acquire().
+        bool Acquire();
+        const uint32_t *GetReadBuffer();
+        const DirtyRegion &GetReadDirtyRegion(); // changed since the frame returned by the previous Acquire()
+        uint8_t GetReadVideoMode(); // VideoMode, the frontends show the top left part of the buffer it selects
+
+        // Clears all buffers. Neither side may use the buffers while this runs.
+        void Clear();
+
+    private:
+        static const uint32_t indexMask = 3;
+        static const uint32_t newFrameFlag = 4;
+
+        uint32_t *buffers[3];
+        size_t pixelCount;
+        DirtyRegion dirtyRegions[3];
+        uint8_t videoModes[3] = {};
+        // changes since the last frame known to have reached the consumer
+        DirtyRegion unseenChanges;
+
+        std::atomic<uint32_t> ready; // index of the newest published buffer, plus newFrameFlag until it is acquired
+        uint32_t writeIndex = 0;
+        uint32_t lastPublishedIndex = 1;
+        uint32_t readIndex = 2;
+    };
+}
@@ -0,0 +1,84 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include <algorithm>
+#include <cstring>
+#include "Upscaler.h"
+#include "Simd.h"
+
+namespace RetroSim::GPU
+{
+    namespace
+    {
+        // Writes every pixel scale times. The common factors handle four pixels at a time, each output
+        // vector is a shuffle of the four source pixels.
+        template <int scale>
+        void WidenRow(const uint32_t *source, int width, uint32_t *destination)
+        {
+            int x = 0;
+#ifdef RETROSIM_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i pixels = _mm_loadu_si128((const __m128i *)(source + x));
+                __m128i *output = (__m128i *)(destination + x * scale);
+                if constexpr (scale == 2)
+                {
+                    _mm_storeu_si128(output, _mm_unpacklo_epi32(pixels, pixels));
+                    _mm_storeu_si128(output + 1, _mm_unpackhi_epi32(pixels, pixels));
+                }
+                else if constexpr (scale == 3)
+                {
+                    _mm_storeu_si128(output, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 0, 0, 0)));
+                    _mm_storeu_si128(output + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 1, 1)));
+                    _mm_storeu_si128(output + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 2)));
+                }
+                else
+                {
+                    _mm_storeu_si128(output, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 0, 0, 0)));
+                    _mm_storeu_si128(output + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 1, 1)));
+                    _mm_storeu_si128(output + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 2, 2)));
+                    _mm_storeu_si128(output + 3, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 3)));
+                }
+            }
+#endif
+            for (; x < width; x++)
+                std::fill_n(destination + x * scale, scale, source[x]);
+        }
+
+        void WidenRow(const uint32_t *source, int width, uint32_t *destination, int scale)
+        {
+            for (int x = 0; x < width; x++)
+                std::fill_n(destination + x * scale, scale, source[x]);
+        }
+    }
+
+    void UpscaleNearest(const uint32_t *source, int sourcePitch, int width, int height, uint32_t *destination, int destinationPitch, int scale)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            const uint32_t *sourceRow = source + (size_t)y * sourcePitch;
+            uint32_t *row = destination + (size_t)y * scale * destinationPitch;
+            switch (scale)
+            {
+            case 1:
+                std::memcpy(row, sourceRow, width * sizeof(uint32_t));
+                break;
+            case 2:
+                WidenRow<2>(sourceRow, width, row);
+                break;
+            case 3:
+                WidenRow<3>(sourceRow, width, row);
+                break;
+            case 4:
+                WidenRow<4>(sourceRow, width, row);
+                break;
+            default:
+                WidenRow(sourceRow, width, row, scale);
+                break;
+            }
+
+            for (int i = 1; i < scale; i++)
+                std::memcpy(row + (size_t)i * destinationPitch, row, (size_t)width * scale * sizeof(uint32_t));
+        }
+    }
+}
@@ -0,0 +1,13 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <cstdint>
+
+namespace RetroSim::GPU
+{
+    // Scales width x height pixels up by an integer factor with nearest neighbour sampling, for the frontends that
+    // write the final image into a streaming texture themselves instead of letting the renderer scale it. Every
+    // source row is widened once and copied to the rest of its output rows. The pitches are in pixels.
+    void UpscaleNearest(const uint32_t *source, int sourcePitch, int width, int height, uint32_t *destination, int destinationPitch, int scale);
+}
@@ -0,0 +1,88 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#include "WorkerPool.h"
+
+namespace RetroSim
+{
+    WorkerPool::~WorkerPool()
+    {
+        Stop();
+    }
+
+    void WorkerPool::Start(int threadCount)
+    {
+        Stop();
+
+        stopping = false;
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(&WorkerPool::WorkerLoop, this, i, generation);
+    }
+
+    void WorkerPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    int WorkerPool::GetThreadCount()
+    {
+        return (int)workers.size() + 1;
+    }
+
+    void WorkerPool::Run(const std::function<void(int)> &task)
+    {
+        if (workers.empty())
+        {
+            task(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentTask = &task;
+            busyWorkers = (int)workers.size();
+            generation++;
+        }
+        wakeUp.notify_all();
+
+        task(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return busyWorkers == 0; });
+        currentTask = nullptr;
+    }
+
+    // The worker gets the generation at the time it was started, so it only picks up tasks submitted later on.
+    void WorkerPool::WorkerLoop(int index, uint64_t lastGeneration)
+    {
+        while (true)
+        {
+            const std::function<void(int)> *task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [&] { return stopping || generation != lastGeneration; });
+                if (stopping)
+                    return;
+
+                lastGeneration = generation;
+                task = currentTask;
+            }
+
+            (*task)(index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            finished.notify_one();
+        }
+    }
+}
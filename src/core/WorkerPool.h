@@ -0,0 +1,41 @@
+// RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
+// https://github.com/arcanelab
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RetroSim
+{
+    // A fixed set of threads that run the same task with different indices, e.g. one band of the frame each.
+    // The calling thread takes part in the work, so a pool of N threads starts N - 1 workers.
+    class WorkerPool
+    {
+    public:
+        ~WorkerPool();
+
+        void Start(int threadCount);
+        void Stop();
+        int GetThreadCount();
+
+        // Calls task(0) ... task(GetThreadCount() - 1) in parallel and returns when all of them are finished.
+        void Run(const std::function<void(int)> &task);
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable finished;
+
+        const std::function<void(int)> *currentTask = nullptr;
+        uint64_t generation = 0;
+        int busyWorkers = 0;
+        bool stopping = false;
+
+        void WorkerLoop(int index, uint64_t lastGeneration);
+    };
+}
@@ -51,6 +51,7 @@ public:
     // ICPUInterface methods
     int Tick(); // returns the number of cycles spent
     void Reset();
+    void InterruptRaised(bool isNMI = false);
 
     void (*syscallHandler)(uint16_t syscallID, uint32_t argumentAddress);
 
@@ -251,7 +252,6 @@ private:
     int HandleAddressingMode_Syscall(const InstructionWord &inst);
 
     void CheckRegisterRange(const int8_t &reg);
-    void InterruptRaised(bool isNMI = false);
     void SetPC(unsigned int newPC);
 
     template <class T>
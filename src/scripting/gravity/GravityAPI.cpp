@@ -1,8 +1,10 @@
 // RetroSim - Copyright 2011-2023 Zoltán Majoros. All rights reserved.
 // https://github.com/arcanelab
 
+#include <algorithm>
 #include <cstdint>
 #include <mutex>
+#include <vector>
 #ifdef WIN32
 #include <limits>
 #endif
@@ -121,34 +123,62 @@ namespace RetroSim::GravityAPI
         if (!VALUE_ISA_STRING(key))
             RETURN_VALUE(VALUE_FROM_NULL, rindex);
 
-        if (strcmp(VALUE_AS_CSTRING(key), "MEMORY_SIZE_U32") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "memory_size_u32") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::memorySize), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "PALETTE_U32") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "palette_u32") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::PALETTE_U32), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "MAP_U8") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "palette_animation_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::PALETTE_ANIMATION), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "palette_fade_target_u32") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::PALETTE_FADE_TARGET_U32), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "map_u8") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::MAP_U8), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "TILES_U8") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "tiles_u8") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::TILES_U8), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "SPRITE_ATLAS_U8") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "sprite_atlas_u8") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::SPRITE_ATLAS_U8), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "BITMAP_U8") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "bitmap_u8") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::BITMAP_U8), rindex);
         }
-        if (strcmp(VALUE_AS_CSTRING(key), "CHARSET_U8") == 0)
+        if (strcmp(VALUE_AS_CSTRING(key), "charset_u8") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::CHARSET_U8), rindex);
         }
+        if (strcmp(VALUE_AS_CSTRING(key), "sprite_attributes_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::SPRITE_ATTRIBUTES), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "tile_layers_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::TILE_LAYERS), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "text_screen_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::TEXT_SCREEN_U8), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "text_color_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::TEXT_COLOR_U8), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "framebuffer_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::FRAMEBUFFER_U8), rindex);
+        }
     }
 
     static bool MemoryPropertySetter(gravity_vm *vm, gravity_value_t *args, uint16_t nargs, uint32_t rindex)
@@ -192,6 +222,46 @@ namespace RetroSim::GravityAPI
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.spriteAtlasPitch), rindex);
         }
+        if (strcmp(VALUE_AS_CSTRING(key), "text_mode_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.textMode), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "text_font_height_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.textFontHeight), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "text_background_color_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.textBackgroundColor), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "sprite_mode_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.spriteMode), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "scanline_mode_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.scanlineMode), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "raster_irq_enabled_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.rasterIrqEnabled), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "raster_irq_line_u16") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.rasterIrqLine), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "current_scanline_u16") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.currentScanline), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "framebuffer_mode_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.framebufferMode), rindex);
+        }
+        if (strcmp(VALUE_AS_CSTRING(key), "video_mode_u8") == 0)
+        {
+            RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.videoMode), rindex);
+        }
         if (strcmp(VALUE_AS_CSTRING(key), "bitmap_pitch_u16") == 0)
         {
             RETURN_VALUE(VALUE_FROM_INT(MMU::memory.gpu.screenWidth), rindex);
@@ -260,6 +330,64 @@ namespace RetroSim::GravityAPI
                 return true;
             }
 
+            if ((strcmp(key, "text_mode_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.textMode = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "text_font_height_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                int valueAsInt = VALUE_AS_INT(value);
+                if (valueAsInt != 8 && valueAsInt != 16)
+                    return false;
+
+                MMU::memory.gpu.textFontHeight = (uint8_t)valueAsInt;
+                return true;
+            }
+
+            if ((strcmp(key, "text_background_color_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.textBackgroundColor = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "sprite_mode_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.spriteMode = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "scanline_mode_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.scanlineMode = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "raster_irq_enabled_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.rasterIrqEnabled = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "raster_irq_line_u16") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.rasterIrqLine = (uint16_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "framebuffer_mode_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.framebufferMode = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
+            if ((strcmp(key, "video_mode_u8") == 0) && VALUE_ISA_INT(value))
+            {
+                MMU::memory.gpu.videoMode = (uint8_t)VALUE_AS_INT(value);
+                return true;
+            }
+
             if ((strcmp(key, "bitmap_pitch_u16") == 0) && VALUE_ISA_INT(value))
             {
                 MMU::memory.gpu.screenWidth = (uint16_t)VALUE_AS_INT(value);
@@ -519,6 +647,199 @@ namespace RetroSim::GravityAPI
         RETURN_NOVALUE();
     }
 
+    // The coordinates of the batch being drawn, reused so the batches don't allocate.
+    std::vector<int32_t> batchCoordinates;
+
+    // A batch's coordinates are either a list of numbers or the address of packed int16 coordinates in memory, followed
+    // by the number of items. Converts them to batchCoordinates, sets the index of the argument after them and returns
+    // nullptr, or an error message.
+    const char *GetBatchCoordinates(gravity_value_t *args, uint16_t nArgs, int valuesPerItem, int &count, uint16_t &nextArg)
+    {
+        gravity_value_t source = GET_VALUE(1);
+
+        if VALUE_ISA_LIST (source)
+        {
+            gravity_list_t *list = VALUE_AS_LIST(source);
+            size_t size = marray_size(list->array);
+            if (size % valuesPerItem != 0 || size / valuesPerItem > INT32_MAX)
+                return "The number of coordinates doesn't match the number of items.";
+
+            batchCoordinates.resize(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                gravity_value_t value = marray_get(list->array, i);
+                gravity_int_t coordinate;
+
+                if VALUE_ISA_INT (value)
+                    coordinate = VALUE_AS_INT(value);
+                else if VALUE_ISA_FLOAT (value)
+                    coordinate = (gravity_int_t)VALUE_AS_FLOAT(value);
+                else
+                    return "Coordinates must be numbers.";
+
+                batchCoordinates[i] = (int32_t)std::clamp<gravity_int_t>(coordinate, INT32_MIN, INT32_MAX);
+            }
+
+            count = (int)(size / valuesPerItem);
+            nextArg = 2;
+            return nullptr;
+        }
+
+        if (nArgs < 3)
+            return "Expected a list of coordinates or an address and a count.";
+
+        gravity_value_t address = GET_VALUE(1);
+        gravity_value_t items = GET_VALUE(2);
+
+        if VALUE_ISA_FLOAT (address)
+            address = VALUE_FROM_INT((gravity_int_t)VALUE_AS_FLOAT(address));
+        else if (!VALUE_ISA_INT(address))
+            return "Address must be an integer or a list.";
+
+        if VALUE_ISA_FLOAT (items)
+            items = VALUE_FROM_INT((gravity_int_t)VALUE_AS_FLOAT(items));
+        else if (!VALUE_ISA_INT(items))
+            return "Count must be an integer.";
+
+        gravity_int_t size = VALUE_AS_INT(items) * valuesPerItem;
+        if (VALUE_AS_INT(items) < 0 || VALUE_AS_INT(items) > (gravity_int_t)MMU::memorySize)
+            return "Count is out of bounds.";
+        if (VALUE_AS_INT(address) < 0 || VALUE_AS_INT(address) + size * (gravity_int_t)sizeof(int16_t) > (gravity_int_t)MMU::memorySize)
+            return "Address is out of bounds.";
+
+        batchCoordinates.resize((size_t)size);
+        {
+            std::lock_guard<std::mutex> lock(Core::GetInstance()->memoryMutex);
+            uint32_t first = (uint32_t)VALUE_AS_INT(address);
+            for (gravity_int_t i = 0; i < size; i++)
+                batchCoordinates[i] = MMU::ReadMem<int16_t>(first + (uint32_t)i * sizeof(int16_t));
+        }
+
+        count = (int)VALUE_AS_INT(items);
+        nextArg = 3;
+        return nullptr;
+    }
+
+    bool DrawPixels(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        int count;
+        uint16_t nextArg;
+        if (const char *error = GetBatchCoordinates(args, nArgs, 2, count, nextArg))
+            RETURN_ERROR("%s", error);
+
+        if (nArgs != nextArg + 1)
+            RETURN_ERROR("DrawPixels() expects a list of x, y coordinates or an address and a count, and a color.");
+
+        gravity_value_t color = GET_VALUE(nextArg);
+
+        if VALUE_ISA_FLOAT (color)
+            INTERNAL_CONVERT_INT(color, true);
+        else if (!VALUE_ISA_INT(color))
+            RETURN_ERROR("Color must be an integer.");
+
+        GPU::DrawPixels(batchCoordinates.data(), count, (uint8_t)VALUE_AS_INT(color));
+        RETURN_NOVALUE();
+    }
+
+    bool DrawPolyline(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        int count;
+        uint16_t nextArg;
+        if (const char *error = GetBatchCoordinates(args, nArgs, 2, count, nextArg))
+            RETURN_ERROR("%s", error);
+
+        if (nArgs != nextArg + 2)
+            RETURN_ERROR("DrawPolyline() expects a list of x, y coordinates or an address and a count, a color and closed.");
+
+        gravity_value_t color = GET_VALUE(nextArg);
+        gravity_value_t closed = GET_VALUE(nextArg + 1);
+
+        if VALUE_ISA_FLOAT (color)
+            INTERNAL_CONVERT_INT(color, true);
+        else if (!VALUE_ISA_INT(color))
+            RETURN_ERROR("Color must be an integer.");
+
+        if (!VALUE_ISA_BOOL(closed))
+            RETURN_ERROR("Closed must be a boolean.");
+
+        GPU::DrawPolyline(batchCoordinates.data(), count, (uint8_t)VALUE_AS_INT(color), (bool)VALUE_AS_BOOL(closed));
+        RETURN_NOVALUE();
+    }
+
+    bool DrawRects(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        int count;
+        uint16_t nextArg;
+        if (const char *error = GetBatchCoordinates(args, nArgs, 4, count, nextArg))
+            RETURN_ERROR("%s", error);
+
+        if (nArgs != nextArg + 2)
+            RETURN_ERROR("DrawRects() expects a list of x, y, width, height values or an address and a count, a color and filled.");
+
+        gravity_value_t color = GET_VALUE(nextArg);
+        gravity_value_t filled = GET_VALUE(nextArg + 1);
+
+        if VALUE_ISA_FLOAT (color)
+            INTERNAL_CONVERT_INT(color, true);
+        else if (!VALUE_ISA_INT(color))
+            RETURN_ERROR("Color must be an integer.");
+
+        if (!VALUE_ISA_BOOL(filled))
+            RETURN_ERROR("Filled must be a boolean.");
+
+        GPU::DrawRects(batchCoordinates.data(), count, (uint8_t)VALUE_AS_INT(color), (bool)VALUE_AS_BOOL(filled));
+        RETURN_NOVALUE();
+    }
+
+    bool FillPolygon(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        int count;
+        uint16_t nextArg;
+        if (const char *error = GetBatchCoordinates(args, nArgs, 2, count, nextArg))
+            RETURN_ERROR("%s", error);
+
+        if (nArgs != nextArg + 1)
+            RETURN_ERROR("FillPolygon() expects a list of x, y coordinates or an address and a count, and a color.");
+
+        gravity_value_t color = GET_VALUE(nextArg);
+
+        if VALUE_ISA_FLOAT (color)
+            INTERNAL_CONVERT_INT(color, true);
+        else if (!VALUE_ISA_INT(color))
+            RETURN_ERROR("Color must be an integer.");
+
+        GPU::FillPolygon(batchCoordinates.data(), count, (uint8_t)VALUE_AS_INT(color));
+        RETURN_NOVALUE();
+    }
+
+    bool FloodFill(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 4)
+            RETURN_ERROR("FloodFill() expects 3 arguments.");
+
+        gravity_value_t x = GET_VALUE(1);
+        gravity_value_t y = GET_VALUE(2);
+        gravity_value_t colorIndex = GET_VALUE(3);
+
+        if VALUE_ISA_FLOAT (x)
+            INTERNAL_CONVERT_INT(x, true);
+        else if (!VALUE_ISA_INT(x))
+            RETURN_ERROR("X must be an integer.");
+
+        if VALUE_ISA_FLOAT (y)
+            INTERNAL_CONVERT_INT(y, true);
+        else if (!VALUE_ISA_INT(y))
+            RETURN_ERROR("Y must be an integer.");
+
+        if VALUE_ISA_FLOAT (colorIndex)
+            INTERNAL_CONVERT_INT(colorIndex, true);
+        else if (!VALUE_ISA_INT(colorIndex))
+            RETURN_ERROR("Color must be an integer.");
+
+        GPU::FloodFill((int)VALUE_AS_INT(x), (int)VALUE_AS_INT(y), (uint8_t)VALUE_AS_INT(colorIndex));
+        RETURN_NOVALUE();
+    }
+
     bool DrawTriangle(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
     {
         if (nArgs != 9)
@@ -615,6 +936,120 @@ namespace RetroSim::GravityAPI
         RETURN_NOVALUE();
     }
 
+    bool SetBlendMode(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 2)
+            RETURN_ERROR("SetBlendMode() expects 1 argument.");
+
+        gravity_value_t mode = GET_VALUE(1);
+
+        if VALUE_ISA_FLOAT (mode)
+            INTERNAL_CONVERT_INT(mode, true);
+        else if (!VALUE_ISA_INT(mode))
+            RETURN_ERROR("Mode must be an integer.");
+
+        GPU::SetBlendMode((uint8_t)VALUE_AS_INT(mode));
+        RETURN_NOVALUE();
+    }
+
+    bool SetStencilMode(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 2)
+            RETURN_ERROR("SetStencilMode() expects 1 argument.");
+
+        gravity_value_t mode = GET_VALUE(1);
+
+        if VALUE_ISA_FLOAT (mode)
+            INTERNAL_CONVERT_INT(mode, true);
+        else if (!VALUE_ISA_INT(mode))
+            RETURN_ERROR("Mode must be an integer.");
+
+        GPU::SetStencilMode((uint8_t)VALUE_AS_INT(mode));
+        RETURN_NOVALUE();
+    }
+
+    bool ClearStencil(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 2)
+            RETURN_ERROR("ClearStencil() expects 1 argument.");
+
+        gravity_value_t value = GET_VALUE(1);
+
+        if (!VALUE_ISA_BOOL(value))
+            RETURN_ERROR("Value must be a boolean.");
+
+        GPU::ClearStencil((bool)VALUE_AS_BOOL(value));
+        RETURN_NOVALUE();
+    }
+
+    bool CopyRect(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 7)
+            RETURN_ERROR("CopyRect() expects 6 arguments.");
+
+        gravity_value_t srcX = GET_VALUE(1);
+        gravity_value_t srcY = GET_VALUE(2);
+        gravity_value_t width = GET_VALUE(3);
+        gravity_value_t height = GET_VALUE(4);
+        gravity_value_t dstX = GET_VALUE(5);
+        gravity_value_t dstY = GET_VALUE(6);
+
+        if VALUE_ISA_FLOAT (srcX)
+            INTERNAL_CONVERT_INT(srcX, true);
+        else if (!VALUE_ISA_INT(srcX))
+            RETURN_ERROR("Source X must be an integer.");
+
+        if VALUE_ISA_FLOAT (srcY)
+            INTERNAL_CONVERT_INT(srcY, true);
+        else if (!VALUE_ISA_INT(srcY))
+            RETURN_ERROR("Source Y must be an integer.");
+
+        if VALUE_ISA_FLOAT (width)
+            INTERNAL_CONVERT_INT(width, true);
+        else if (!VALUE_ISA_INT(width))
+            RETURN_ERROR("Width must be an integer.");
+
+        if VALUE_ISA_FLOAT (height)
+            INTERNAL_CONVERT_INT(height, true);
+        else if (!VALUE_ISA_INT(height))
+            RETURN_ERROR("Height must be an integer.");
+
+        if VALUE_ISA_FLOAT (dstX)
+            INTERNAL_CONVERT_INT(dstX, true);
+        else if (!VALUE_ISA_INT(dstX))
+            RETURN_ERROR("Destination X must be an integer.");
+
+        if VALUE_ISA_FLOAT (dstY)
+            INTERNAL_CONVERT_INT(dstY, true);
+        else if (!VALUE_ISA_INT(dstY))
+            RETURN_ERROR("Destination Y must be an integer.");
+
+        GPU::CopyRect((int)VALUE_AS_INT(srcX), (int)VALUE_AS_INT(srcY), (int)VALUE_AS_INT(width), (int)VALUE_AS_INT(height), (int)VALUE_AS_INT(dstX), (int)VALUE_AS_INT(dstY));
+        RETURN_NOVALUE();
+    }
+
+    bool Scroll(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 3)
+            RETURN_ERROR("Scroll() expects 2 arguments.");
+
+        gravity_value_t dx = GET_VALUE(1);
+        gravity_value_t dy = GET_VALUE(2);
+
+        if VALUE_ISA_FLOAT (dx)
+            INTERNAL_CONVERT_INT(dx, true);
+        else if (!VALUE_ISA_INT(dx))
+            RETURN_ERROR("DX must be an integer.");
+
+        if VALUE_ISA_FLOAT (dy)
+            INTERNAL_CONVERT_INT(dy, true);
+        else if (!VALUE_ISA_INT(dy))
+            RETURN_ERROR("DY must be an integer.");
+
+        GPU::Scroll((int)VALUE_AS_INT(dx), (int)VALUE_AS_INT(dy));
+        RETURN_NOVALUE();
+    }
+
     bool SetFont(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
     {
         if (nArgs != 4)
@@ -817,6 +1252,77 @@ namespace RetroSim::GravityAPI
         RETURN_NOVALUE();
     }
 
+    bool DrawTransformedSprite(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
+    {
+        if (nArgs != 11)
+            RETURN_ERROR("DrawTransformedSprite() expects 10 arguments.");
+
+        gravity_value_t x = GET_VALUE(1);
+        gravity_value_t y = GET_VALUE(2);
+        gravity_value_t spritex = GET_VALUE(3);
+        gravity_value_t spritey = GET_VALUE(4);
+        gravity_value_t width = GET_VALUE(5);
+        gravity_value_t height = GET_VALUE(6);
+        gravity_value_t scalex = GET_VALUE(7);
+        gravity_value_t scaley = GET_VALUE(8);
+        gravity_value_t angle = GET_VALUE(9);
+        gravity_value_t transparentColorIndex = GET_VALUE(10);
+
+        if VALUE_ISA_FLOAT (x)
+            INTERNAL_CONVERT_INT(x, true);
+        else if (!VALUE_ISA_INT(x))
+            RETURN_ERROR("X must be an integer.");
+
+        if VALUE_ISA_FLOAT (y)
+            INTERNAL_CONVERT_INT(y, true);
+        else if (!VALUE_ISA_INT(y))
+            RETURN_ERROR("Y must be an integer.");
+
+        if VALUE_ISA_FLOAT (spritex)
+            INTERNAL_CONVERT_INT(spritex, true);
+        else if (!VALUE_ISA_INT(spritex))
+            RETURN_ERROR("Sprite X must be an integer.");
+
+        if VALUE_ISA_FLOAT (spritey)
+            INTERNAL_CONVERT_INT(spritey, true);
+        else if (!VALUE_ISA_INT(spritey))
+            RETURN_ERROR("Sprite Y must be an integer.");
+
+        if VALUE_ISA_FLOAT (width)
+            INTERNAL_CONVERT_INT(width, true);
+        else if (!VALUE_ISA_INT(width))
+            RETURN_ERROR("Width must be an integer.");
+
+        if VALUE_ISA_FLOAT (height)
+            INTERNAL_CONVERT_INT(height, true);
+        else if (!VALUE_ISA_INT(height))
+            RETURN_ERROR("Height must be an integer.");
+
+        if VALUE_ISA_INT (scalex)
+            scalex = VALUE_FROM_FLOAT((gravity_float_t)VALUE_AS_INT(scalex));
+        else if (!VALUE_ISA_FLOAT(scalex))
+            RETURN_ERROR("Scale X must be a number.");
+
+        if VALUE_ISA_INT (scaley)
+            scaley = VALUE_FROM_FLOAT((gravity_float_t)VALUE_AS_INT(scaley));
+        else if (!VALUE_ISA_FLOAT(scaley))
+            RETURN_ERROR("Scale Y must be a number.");
+
+        if VALUE_ISA_INT (angle)
+            angle = VALUE_FROM_FLOAT((gravity_float_t)VALUE_AS_INT(angle));
+        else if (!VALUE_ISA_FLOAT(angle))
+            RETURN_ERROR("Angle must be a number.");
+
+        if VALUE_ISA_FLOAT (transparentColorIndex)
+            INTERNAL_CONVERT_INT(transparentColorIndex, true);
+        else if (!VALUE_ISA_INT(transparentColorIndex))
+            RETURN_ERROR("Transparent color index must be an integer.");
+
+        GPU::DrawTransformedSprite((int)VALUE_AS_INT(x), (int)VALUE_AS_INT(y), (int)VALUE_AS_INT(spritex), (int)VALUE_AS_INT(spritey), (int)VALUE_AS_INT(width), (int)VALUE_AS_INT(height),
+                                   (float)VALUE_AS_FLOAT(scalex), (float)VALUE_AS_FLOAT(scaley), (float)VALUE_AS_FLOAT(angle), (int)VALUE_AS_INT(transparentColorIndex));
+        RETURN_NOVALUE();
+    }
+
     bool DrawBitmap(gravity_vm *vm, gravity_value_t *args, uint16_t nArgs, uint32_t rindex)
     {
         if (nArgs < 7)
@@ -912,11 +1418,18 @@ namespace RetroSim::GravityAPI
         gravity_value_t value = VALUE_FROM_OBJECT(closure);
         gravity_class_bind(meta, "memory_size_u32", value);
         gravity_class_bind(meta, "palette_u32", value);
+        gravity_class_bind(meta, "palette_animation_u8", value);
+        gravity_class_bind(meta, "palette_fade_target_u32", value);
         gravity_class_bind(meta, "map_u8", value);
         gravity_class_bind(meta, "tiles_u8", value);
         gravity_class_bind(meta, "sprite_atlas_u8", value);
         gravity_class_bind(meta, "bitmap_u8", value);
         gravity_class_bind(meta, "charset_u8", value);
+        gravity_class_bind(meta, "sprite_attributes_u8", value);
+        gravity_class_bind(meta, "tile_layers_u8", value);
+        gravity_class_bind(meta, "text_screen_u8", value);
+        gravity_class_bind(meta, "text_color_u8", value);
+        gravity_class_bind(meta, "framebuffer_u8", value);
 
         // register class
         gravity_vm_setvalue(vm, "memory", VALUE_FROM_OBJECT(c));
@@ -960,6 +1473,26 @@ namespace RetroSim::GravityAPI
         gravity_closure_t *rectc = gravity_closure_new(vm, rectf);
         gravity_class_bind(meta, "rect", VALUE_FROM_OBJECT(rectc));
 
+        gravity_function_t *pixelsf = gravity_function_new_internal(vm, NULL, DrawPixels, 0);
+        gravity_closure_t *pixelsc = gravity_closure_new(vm, pixelsf);
+        gravity_class_bind(meta, "pixels", VALUE_FROM_OBJECT(pixelsc));
+
+        gravity_function_t *polylinef = gravity_function_new_internal(vm, NULL, DrawPolyline, 0);
+        gravity_closure_t *polylinec = gravity_closure_new(vm, polylinef);
+        gravity_class_bind(meta, "polyline", VALUE_FROM_OBJECT(polylinec));
+
+        gravity_function_t *rectsf = gravity_function_new_internal(vm, NULL, DrawRects, 0);
+        gravity_closure_t *rectsc = gravity_closure_new(vm, rectsf);
+        gravity_class_bind(meta, "rects", VALUE_FROM_OBJECT(rectsc));
+
+        gravity_function_t *polygonf = gravity_function_new_internal(vm, NULL, FillPolygon, 0);
+        gravity_closure_t *polygonc = gravity_closure_new(vm, polygonf);
+        gravity_class_bind(meta, "polygon", VALUE_FROM_OBJECT(polygonc));
+
+        gravity_function_t *floodfillf = gravity_function_new_internal(vm, NULL, FloodFill, 0);
+        gravity_closure_t *floodfillc = gravity_closure_new(vm, floodfillf);
+        gravity_class_bind(meta, "floodfill", VALUE_FROM_OBJECT(floodfillc));
+
         gravity_function_t *trif = gravity_function_new_internal(vm, NULL, DrawTriangle, 0);
         gravity_closure_t *tric = gravity_closure_new(vm, trif);
         gravity_class_bind(meta, "tri", VALUE_FROM_OBJECT(tric));
@@ -972,6 +1505,26 @@ namespace RetroSim::GravityAPI
         gravity_closure_t *noclipc = gravity_closure_new(vm, noclipf);
         gravity_class_bind(meta, "noclip", VALUE_FROM_OBJECT(noclipc));
 
+        gravity_function_t *blendf = gravity_function_new_internal(vm, NULL, SetBlendMode, 0);
+        gravity_closure_t *blendc = gravity_closure_new(vm, blendf);
+        gravity_class_bind(meta, "blend", VALUE_FROM_OBJECT(blendc));
+
+        gravity_function_t *stencilf = gravity_function_new_internal(vm, NULL, SetStencilMode, 0);
+        gravity_closure_t *stencilc = gravity_closure_new(vm, stencilf);
+        gravity_class_bind(meta, "stencil", VALUE_FROM_OBJECT(stencilc));
+
+        gravity_function_t *clearstencilf = gravity_function_new_internal(vm, NULL, ClearStencil, 0);
+        gravity_closure_t *clearstencilc = gravity_closure_new(vm, clearstencilf);
+        gravity_class_bind(meta, "clearstencil", VALUE_FROM_OBJECT(clearstencilc));
+
+        gravity_function_t *copyf = gravity_function_new_internal(vm, NULL, CopyRect, 0);
+        gravity_closure_t *copyc = gravity_closure_new(vm, copyf);
+        gravity_class_bind(meta, "copy", VALUE_FROM_OBJECT(copyc));
+
+        gravity_function_t *scrollf = gravity_function_new_internal(vm, NULL, Scroll, 0);
+        gravity_closure_t *scrollc = gravity_closure_new(vm, scrollf);
+        gravity_class_bind(meta, "scroll", VALUE_FROM_OBJECT(scrollc));
+
         gravity_function_t *setfontf = gravity_function_new_internal(vm, NULL, SetFont, 0);
         gravity_closure_t *setfontc = gravity_closure_new(vm, setfontf);
         gravity_class_bind(meta, "setfont", VALUE_FROM_OBJECT(setfontc));
@@ -992,6 +1545,10 @@ namespace RetroSim::GravityAPI
         gravity_closure_t *spritec = gravity_closure_new(vm, spritef);
         gravity_class_bind(meta, "sprite", VALUE_FROM_OBJECT(spritec));
 
+        gravity_function_t *spritetransformf = gravity_function_new_internal(vm, NULL, DrawTransformedSprite, 0);
+        gravity_closure_t *spritetransformc = gravity_closure_new(vm, spritetransformf);
+        gravity_class_bind(meta, "spritetransform", VALUE_FROM_OBJECT(spritetransformc));
+
         gravity_function_t *bitmapf = gravity_function_new_internal(vm, NULL, DrawBitmap, 0);
         gravity_closure_t *bitmapc = gravity_closure_new(vm, bitmapf);
         gravity_class_bind(meta, "bitmap", VALUE_FROM_OBJECT(bitmapc));
@@ -1006,6 +1563,16 @@ namespace RetroSim::GravityAPI
         gravity_class_bind(meta, "map_width_u8", value);
         gravity_class_bind(meta, "map_height_u8", value);
         gravity_class_bind(meta, "sprite_atlas_pitch_u8", value);
+        gravity_class_bind(meta, "text_mode_u8", value);
+        gravity_class_bind(meta, "text_font_height_u8", value);
+        gravity_class_bind(meta, "text_background_color_u8", value);
+        gravity_class_bind(meta, "sprite_mode_u8", value);
+        gravity_class_bind(meta, "scanline_mode_u8", value);
+        gravity_class_bind(meta, "raster_irq_enabled_u8", value);
+        gravity_class_bind(meta, "raster_irq_line_u16", value);
+        gravity_class_bind(meta, "current_scanline_u16", value);
+        gravity_class_bind(meta, "framebuffer_mode_u8", value);
+        gravity_class_bind(meta, "video_mode_u8", value);
         gravity_class_bind(meta, "bitmap_pitch_u16", value);
         gravity_class_bind(meta, "character_color_index_u8", value);
         gravity_class_bind(meta, "fixed_frame_time_u32", value);
@@ -5,9 +5,11 @@
 
 #include "LibRetroCore.h"
 #include "GPU.h"
+#include "TripleBuffer.h"
 #include "MMU.h"
 #include "Logger.h"
 #include "FileUtils.h"
+#include <algorithm>
 
 namespace RetroSim
 {
@@ -25,6 +27,9 @@ namespace RetroSim
         // Communicate to the frontend that we don't require a game before running the core.
         bool noGameSupport = true;
         envCallback(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &noGameSupport);
+
+        if (!envCallback(RETRO_ENVIRONMENT_GET_CAN_DUPE, &canDupe))
+            canDupe = false;
     }
 
     void LibRetroCore::Init()
@@ -32,10 +37,18 @@ namespace RetroSim
         // GetSystemDirectory();
         SetupCore();
 
+        CoreConfig config = coreInstance->GetCoreConfig();
+        crtFilterEnabled = config.GetCrtFilterScale() > 0;
+        frameScale = crtFilterEnabled ? config.GetCrtFilterScale() : 1;
+        if (crtFilterEnabled)
+            crtFilter.SetThreadCount(config.GetRenderThreads());
+        SetOutputSize(GPU::GetVideoModeInfo(videoMode));
+
+        // large enough for either pixel format
         if (windowBuffer == nullptr)
-            windowBuffer = new uint32_t[GPU::windowWidth * GPU::windowHeight];
+            windowBuffer = new uint8_t[GPU::windowWidth * GPU::windowHeight * frameScale * frameScale * sizeof(uint32_t)];
 
-        memset(windowBuffer, 0, GPU::windowWidth * GPU::windowHeight * sizeof(uint32_t));
+        windowBufferValid = false;
     }
 
     void LibRetroCore::SetVideoRefreshCallback(retro_video_refresh_t renderCallback)
@@ -43,26 +56,117 @@ namespace RetroSim
         this->renderCallback = renderCallback;
     }
 
-    void LibRetroCore::BlitToRenderBuffer()
+    // The frames of a low resolution mode are sent at half the size, with the same border around the screen,
+    // and the frontend is told to expect the new size. It scales them up like any other frame.
+    void LibRetroCore::SetVideoMode(uint8_t newVideoMode)
+    {
+        videoMode = newVideoMode;
+        SetOutputSize(GPU::GetVideoModeInfo(newVideoMode));
+
+        retro_game_geometry geometry = {};
+        geometry.base_width = outputWidth;
+        geometry.base_height = outputHeight;
+        geometry.max_width = GPU::windowWidth * frameScale;
+        geometry.max_height = GPU::windowHeight * frameScale;
+        geometry.aspect_ratio = 0;
+        envCallback(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry);
+
+        // the border around the new screen may still show the previous one
+        windowBufferValid = false;
+    }
+
+    // The texture is sent without a border, the other outputs have one around the screen.
+    void LibRetroCore::SetOutputSize(const GPU::VideoModeInfo &info)
+    {
+        outputWidth = sendsTexture ? info.width : GPU::windowWidth / info.scale * frameScale;
+        outputHeight = sendsTexture ? info.height : GPU::windowHeight / info.scale * frameScale;
+    }
+
+    // The output texture has the red channel in the lowest byte unless the GPU renders XRGB8888.
+    static inline uint16_t ConvertToRGB565(uint32_t pixel)
+    {
+        return (uint16_t)(((pixel & 0xf8) << 8) | ((pixel >> 5) & 0x7e0) | ((pixel >> 19) & 0x1f));
+    }
+
+    // Converts the screen of the acquired frame into destination, in RGB565. When the destination
+    // holds the previous frame only the parts that changed are converted, otherwise all of it.
+    void LibRetroCore::Resolve(uint8_t *destination, size_t pitch, bool holdsPreviousFrame)
     {
-        uint32_t *dst = (uint32_t *)windowBuffer + GPU::windowWidth * (GPU::windowHeight - GPU::textureHeight) / 2 + (GPU::windowWidth - GPU::textureWidth) / 2;
-        uint32_t *src = (uint32_t *)GPU::outputTexture;
-        for (uint_fast16_t y = 0; y < GPU::textureHeight; y++)
+        const GPU::VideoModeInfo &info = GPU::GetVideoModeInfo(videoMode);
+        int borderX = (outputWidth - info.width) / 2;
+        int borderY = (outputHeight - info.height) / 2;
+
+        if (holdsPreviousFrame)
+        {
+            GPU::outputTexture.GetReadDirtyRegion().GetRects(dirtyRects);
+        }
+        else
         {
-            for (uint_fast16_t x = 0; x < GPU::textureWidth; x++)
+            dirtyRects.assign(1, GPU::DirtyRect{0, 0, info.width, info.height});
+            for (int y = 0; y < (int)outputHeight; y++)
             {
-                uint32_t pixel = *src++;
-                uint8_t a = (pixel >> 24) & 0xff;
-                uint8_t r = (pixel >> 16) & 0xff;
-                uint8_t g = (pixel >> 8) & 0xff;
-                uint8_t b = (pixel >> 0) & 0xff;
-                *dst++ = (a << 24) | (b << 16) | (g << 8) | (r << 0);
+                uint16_t *row = (uint16_t *)(destination + y * pitch);
+                if (y < borderY || y >= borderY + info.height)
+                {
+                    std::fill_n(row, outputWidth, (uint16_t)0);
+                }
+                else
+                {
+                    std::fill_n(row, borderX, (uint16_t)0);
+                    std::fill(row + borderX + info.width, row + outputWidth, (uint16_t)0);
+                }
             }
+        }
+
+        uint16_t *content = (uint16_t *)(destination + borderY * pitch) + borderX;
+        const uint32_t *texture = GPU::outputTexture.GetReadBuffer();
 
-            dst += GPU::windowWidth - GPU::textureWidth;
+        for (GPU::DirtyRect rect : dirtyRects)
+        {
+            // the rest of the texture isn't part of the screen, it would show in the border
+            rect.width = std::min(rect.width, info.width - rect.x);
+            rect.height = std::min(rect.height, info.height - rect.y);
+            if (rect.width > 0 && rect.height > 0)
+                BlitRect(content, pitch, texture, rect);
+        }
+    }
+
+    void LibRetroCore::BlitRect(uint16_t *content, size_t pitch, const uint32_t *texture, const GPU::DirtyRect &rect)
+    {
+        for (int y = rect.y; y < rect.y + rect.height; y++)
+        {
+            uint16_t *dst = (uint16_t *)((uint8_t *)content + y * pitch) + rect.x;
+            const uint32_t *src = texture + y * GPU::textureWidth + rect.x;
+            for (int x = 0; x < rect.width; x++)
+                dst[x] = ConvertToRGB565(src[x]);
         }
     }
 
+    void LibRetroCore::ResolveFrame(uint8_t *destination, size_t pitch, bool holdsPreviousFrame)
+    {
+        if (crtFilterEnabled)
+            ApplyCrtFilter(destination, pitch);
+        else
+            Resolve(destination, pitch, holdsPreviousFrame);
+    }
+
+    // The CRT filter spreads every pixel over its neighbours, so the whole frame is filtered each time, into XRGB8888.
+    void LibRetroCore::ApplyCrtFilter(uint8_t *destination, size_t pitch)
+    {
+        const GPU::VideoModeInfo &info = GPU::GetVideoModeInfo(videoMode);
+        GPU::CrtFilter::Source source = {};
+        source.pixels = GPU::outputTexture.GetReadBuffer();
+        source.pitch = GPU::textureWidth;
+        source.width = outputWidth / frameScale;
+        source.height = outputHeight / frameScale;
+        source.screenWidth = info.width;
+        source.screenHeight = info.height;
+        source.x = (source.width - info.width) / 2;
+        source.y = (source.height - info.height) / 2;
+
+        crtFilter.Apply(source, frameScale, MMU::memory.shaderParameters, (uint32_t *)destination, (int)(pitch / sizeof(uint32_t)), true);
+    }
+
     void LibRetroCore::Run()
     {
         // TODO: check for input
@@ -70,8 +174,46 @@ namespace RetroSim
 
         Core::GetInstance()->RunNextFrame();
 
-        BlitToRenderBuffer();
-        renderCallback(windowBuffer, GPU::windowWidth, GPU::windowHeight, GPU::windowWidth * sizeof(uint32_t));
+        bool newFrame = GPU::outputTexture.Acquire();
+        if (newFrame && GPU::outputTexture.GetReadVideoMode() != videoMode)
+            SetVideoMode(GPU::outputTexture.GetReadVideoMode());
+
+        // when nothing changed the frontend is asked to show the last frame again
+        if (!newFrame && canDupe)
+        {
+            renderCallback(nullptr, outputWidth, outputHeight, 0);
+            return;
+        }
+
+        // The read buffer stays valid until the next Acquire(), so the frontend can take the pixels from the texture.
+        if (sendsTexture)
+        {
+            renderCallback(GPU::outputTexture.GetReadBuffer(), outputWidth, outputHeight, GPU::textureWidth * sizeof(uint32_t));
+            return;
+        }
+
+        // The CRT filter writes every pixel of the frame, so it writes straight into the frontend's framebuffer
+        // when it offers one, which saves it a copy.
+        retro_framebuffer framebuffer = {};
+        framebuffer.width = outputWidth;
+        framebuffer.height = outputHeight;
+        framebuffer.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+        if (crtFilterEnabled && envCallback(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &framebuffer) && framebuffer.data != nullptr && framebuffer.format == pixelFormat)
+        {
+            ResolveFrame((uint8_t *)framebuffer.data, framebuffer.pitch, false);
+            renderCallback(framebuffer.data, outputWidth, outputHeight, framebuffer.pitch);
+            windowBufferValid = false;
+            return;
+        }
+
+        // windowBuffer keeps the last frame, only the changes since it are converted
+        size_t pitch = GPU::windowWidth * frameScale * (pixelFormat == RETRO_PIXEL_FORMAT_RGB565 ? sizeof(uint16_t) : sizeof(uint32_t));
+        if (newFrame || !windowBufferValid)
+        {
+            ResolveFrame(windowBuffer, pitch, windowBufferValid);
+            windowBufferValid = true;
+        }
+        renderCallback(windowBuffer, outputWidth, outputHeight, pitch);
     }
 
     void LibRetroCore::GetSystemInfo(struct retro_system_info *info)
@@ -89,10 +231,10 @@ namespace RetroSim
         float aspect = 0; // zero defaults to width/height
         float sampling_rate = (float)Core::GetInstance()->GetSampleRate();
 
-        info->geometry.base_width = GPU::windowWidth;
-        info->geometry.base_height = GPU::windowHeight;
-        info->geometry.max_width = GPU::windowWidth;
-        info->geometry.max_height = GPU::windowHeight;
+        info->geometry.base_width = outputWidth;
+        info->geometry.base_height = outputHeight;
+        info->geometry.max_width = GPU::windowWidth * frameScale;
+        info->geometry.max_height = GPU::windowHeight * frameScale;
         info->geometry.aspect_ratio = 0;
         info->timing.fps = coreInstance->GetCoreConfig().GetFPS();
         info->timing.sample_rate = sampling_rate;
@@ -102,8 +244,7 @@ namespace RetroSim
 
         // Note: this might not even be necessary as the core runs fine without this call.
         // Leaving it here for good measure.
-        retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_XRGB8888;
-        envCallback(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format);
+        envCallback(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixelFormat);
     }
 
     bool LibRetroCore::LoadGame(const struct retro_game_info *info)
@@ -121,12 +262,21 @@ namespace RetroSim
         envCallback(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
         // Note: This can be called either here or in GetSystemAudioVideoInfo().
-        enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
-        if (!envCallback(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+        // RGB565 halves the bandwidth of the frames, XRGB8888 is the fallback. The CRT filter only writes XRGB8888.
+        pixelFormat = RETRO_PIXEL_FORMAT_RGB565;
+        if (!Core::GetInstance()->GetCoreConfig().IsRGB565Output() || crtFilterEnabled || !envCallback(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixelFormat))
         {
-            Logger::LogPrintf(RETRO_LOG_INFO, "XRGB8888 is not supported.\n");
-            return false;
+            pixelFormat = RETRO_PIXEL_FORMAT_XRGB8888;
+            if (!envCallback(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixelFormat))
+            {
+                Logger::LogPrintf(RETRO_LOG_INFO, "XRGB8888 is not supported.\n");
+                return false;
+            }
         }
+        sendsTexture = pixelFormat == RETRO_PIXEL_FORMAT_XRGB8888 && !crtFilterEnabled;
+        GPU::SetOutputFormat(sendsTexture ? GPU::OUTPUT_ARGB8888 : GPU::OUTPUT_ABGR8888);
+        SetOutputSize(GPU::GetVideoModeInfo(videoMode));
+        windowBufferValid = false;
 
         struct retro_audio_callback audio_cb = {GenerateAudio, SetAudioState};
         use_audio_cb = envCallback(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, &audio_cb);
@@ -5,8 +5,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "libretro.h"
 #include "Core.h"
+#include "DirtyRegion.h"
+#include "CrtFilter.h"
 
 namespace RetroSim
 {
@@ -30,7 +33,21 @@ namespace RetroSim
     private:
         std::string systemDirectory = ".";
         std::string saveDirectory = ".";
-        uint32_t *windowBuffer = nullptr;
+        uint8_t *windowBuffer = nullptr;  // the last frame sent, in pixelFormat, unless the frontend's framebuffer or the texture was used
+        bool windowBufferValid = false;   // windowBuffer holds the frame acquired last
+        std::vector<GPU::DirtyRect> dirtyRects;
+        bool canDupe = false; // the frontend can show the previous frame again, so unchanged frames needn't be sent
+        // the video mode of the frames sent, the low resolution modes are sent at half the size
+        uint8_t videoMode = GPU::VIDEO_MODE_464X256;
+        unsigned outputWidth = GPU::windowWidth;
+        unsigned outputHeight = GPU::windowHeight;
+        retro_pixel_format pixelFormat = RETRO_PIXEL_FORMAT_XRGB8888;
+        // in XRGB8888 the GPU renders in the frontend's channel order and the screen of the output texture is sent as it is
+        bool sendsTexture = false;
+        // with the software CRT filter the frames are sent this many times larger, 1 without it
+        int frameScale = 1;
+        bool crtFilterEnabled = false;
+        GPU::CrtFilter crtFilter;
 
         Core *coreInstance = nullptr;
 
@@ -45,7 +62,12 @@ namespace RetroSim
         void SetupControllers();
         void GetSystemDirectory();
         void SetupCore();
-        void BlitToRenderBuffer();
+        void SetVideoMode(uint8_t newVideoMode);
+        void SetOutputSize(const GPU::VideoModeInfo &info);
+        void ResolveFrame(uint8_t *destination, size_t pitch, bool holdsPreviousFrame);
+        void ApplyCrtFilter(uint8_t *destination, size_t pitch);
+        void Resolve(uint8_t *destination, size_t pitch, bool holdsPreviousFrame);
+        void BlitRect(uint16_t *content, size_t pitch, const uint32_t *texture, const GPU::DirtyRect &rect);
     }; // class LibRetroCore
 } // namespace RetroSim
 
@@ -2,6 +2,8 @@
 // https://github.com/arcanelab
 
 #include "RaylibApp.h"
+#include "TripleBuffer.h"
+#include <cstring>
 #ifdef IMGUI
 #include "imgui.h"
 #include "rlImGui.h"
@@ -31,6 +33,7 @@ namespace RetroSim
         Texture2D drawTexture = LoadTextureFromImage(drawBuffer);
         UnloadImage(drawBuffer);
 
+        GPU::VideoModeInfo videoMode = GPU::GetVideoModeInfo(GPU::VIDEO_MODE_464X256);
         Vector2 border = {(GPU::windowWidth - GPU::textureWidth) * effectiveScalingFactor / 2.0f, (GPU::windowHeight - GPU::textureHeight) * effectiveScalingFactor / 2.0f};
 
         while (!WindowShouldClose())
@@ -42,10 +45,18 @@ namespace RetroSim
             BeginDrawing();
             {
                 ClearBackground(BLANK);
-                UpdateTexture(drawTexture, GPU::outputTexture);
+                if (GPU::outputTexture.Acquire())
+                {
+                    UploadDirtyRects(drawTexture);
+                    videoMode = GPU::GetVideoModeInfo(GPU::outputTexture.GetReadVideoMode());
+                }
                 BeginShaderMode(shader.GetShader());
                 {
-                    DrawTextureEx(drawTexture, border, 0.0f, (float)core->GetCoreConfig().GetWindowScale() * desktopScalingFactor, WHITE);
+                    // the low resolution video modes use the top left part of the texture, it is scaled up while drawn
+                    float scale = (float)core->GetCoreConfig().GetWindowScale() * desktopScalingFactor;
+                    Rectangle source = {0, 0, (float)videoMode.width, (float)videoMode.height};
+                    Rectangle destination = {border.x, border.y, GPU::textureWidth * scale, GPU::textureHeight * scale};
+                    DrawTexturePro(drawTexture, source, destination, {0, 0}, 0.0f, WHITE);
                 }
                 EndShaderMode();
 #ifdef IMGUI
@@ -91,4 +102,21 @@ namespace RetroSim
         SetTargetFPS(refreshRate);
     }
 
+    // Uploads the parts of the output texture that changed since the last uploaded frame.
+    void RaylibApp::UploadDirtyRects(Texture2D texture)
+    {
+        const uint32_t *frame = GPU::outputTexture.GetReadBuffer();
+        GPU::outputTexture.GetReadDirtyRegion().GetRects(dirtyRects);
+
+        for (const GPU::DirtyRect &dirtyRect : dirtyRects)
+        {
+            uploadBuffer.resize(dirtyRect.width * dirtyRect.height);
+            for (int y = 0; y < dirtyRect.height; y++)
+                memcpy(uploadBuffer.data() + y * dirtyRect.width, frame + (dirtyRect.y + y) * GPU::textureWidth + dirtyRect.x, dirtyRect.width * sizeof(uint32_t));
+
+            Rectangle rect = {(float)dirtyRect.x, (float)dirtyRect.y, (float)dirtyRect.width, (float)dirtyRect.height};
+            UpdateTextureRec(texture, rect, uploadBuffer.data());
+        }
+    }
+
 } // namespace
@@ -4,6 +4,8 @@
 #include "raylib.h"
 #include "Core.h"
 #include "GPU.h"
+#include "DirtyRegion.h"
+#include <vector>
 #include "Logger.h"
 #include "FileUtils.h"
 #include "DesktopDPI.h"
@@ -35,7 +37,11 @@ namespace RetroSim
 
         Raylib::RaylibShader shader;
 
+        std::vector<GPU::DirtyRect> dirtyRects;
+        std::vector<uint32_t> uploadBuffer; // UpdateTextureRec() expects the pixels of the rectangle packed
+
         void InitializeWindow();
+        void UploadDirtyRects(Texture2D texture);
         void DrawImgui();
 
 #ifdef IMGUI
@@ -5,7 +5,11 @@
 #include "CoreConfig.h"
 #include "Core.h"
 #include "GPU.h"
+#include "TripleBuffer.h"
+#include "Upscaler.h"
 #include <SDL.h>
+#include <algorithm>
+#include <vector>
 
 using namespace RetroSim;
 
@@ -15,8 +19,17 @@ namespace RetroSim::SDLApp
     SDL_Renderer *renderer;
     SDL_Texture *texture;
 
+    // With software scaling the texture has the size of the image in the window. The frames are scaled into it
+    // on the CPU by an integer factor and the renderer only copies it, which spares software renderers their
+    // generic scaling.
+    bool softwareScaling = false;
+    int upscale = 0;
+    SDL_Rect upscaledRect;
+
     void CreateSDLWindow();
     void RunMainLoop();
+    bool ResizeUpscaledTexture();
+    void UpscaleRect(const uint32_t *frame, GPU::DirtyRect rect, const GPU::VideoModeInfo &videoMode);
 
     void Run(std::string scriptFileName)
     {
@@ -38,23 +51,73 @@ namespace RetroSim::SDLApp
     {
         SDL_Event event;
         bool quit = false;
+        bool presentRequired = true; // the window contents have to be drawn again, e.g. after being exposed
+        std::vector<GPU::DirtyRect> dirtyRects;
 
         // uint32_t lastFrameTime = 0;
         SDL_Rect destinationRect = {(GPU::windowWidth - GPU::textureWidth) / 2, (GPU::windowHeight - GPU::textureHeight) / 2, GPU::textureWidth, GPU::textureHeight};
+        // the low resolution video modes use the top left part of the texture, the renderer scales it up
+        SDL_Rect sourceRect = {0, 0, GPU::textureWidth, GPU::textureHeight};
+        const GPU::VideoModeInfo *videoMode = &GPU::GetVideoModeInfo(GPU::VIDEO_MODE_464X256);
         while (!quit)
         {
             // uint32_t frameStartTime = SDL_GetTicks();
             Core::GetInstance()->RunNextFrame();
-            SDL_UpdateTexture(texture, NULL, GPU::outputTexture, GPU::textureWidth * sizeof(uint32_t));
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, NULL, &destinationRect);
-            SDL_RenderPresent(renderer);
+
+            // Only the parts of the texture changed since the last uploaded frame are uploaded.
+            if (GPU::outputTexture.Acquire())
+            {
+                const uint32_t *frame = GPU::outputTexture.GetReadBuffer();
+                videoMode = &GPU::GetVideoModeInfo(GPU::outputTexture.GetReadVideoMode());
+                sourceRect.w = videoMode->width;
+                sourceRect.h = videoMode->height;
+                GPU::outputTexture.GetReadDirtyRegion().GetRects(dirtyRects);
+                for (const GPU::DirtyRect &dirtyRect : dirtyRects)
+                {
+                    if (softwareScaling)
+                    {
+                        UpscaleRect(frame, dirtyRect, *videoMode);
+                        continue;
+                    }
+
+                    SDL_Rect rect = {dirtyRect.x, dirtyRect.y, dirtyRect.width, dirtyRect.height};
+                    SDL_UpdateTexture(texture, &rect, frame + dirtyRect.y * GPU::textureWidth + dirtyRect.x, GPU::textureWidth * sizeof(uint32_t));
+                }
+
+                if (!dirtyRects.empty())
+                    presentRequired = true;
+            }
+
+            if (presentRequired)
+            {
+                SDL_RenderClear(renderer);
+                if (softwareScaling)
+                    SDL_RenderCopy(renderer, texture, nullptr, &upscaledRect);
+                else
+                    SDL_RenderCopy(renderer, texture, &sourceRect, &destinationRect);
+                SDL_RenderPresent(renderer);
+                presentRequired = false;
+            }
+            else
+            {
+                // nothing changed, wait for the next frame instead of presenting (and waiting for vsync)
+                SDL_Delay(1000 / Core::GetInstance()->GetCoreConfig().GetFPS());
+            }
 
             while (SDL_PollEvent(&event))
             {
                 if (event.type == SDL_QUIT)
                     quit = true;
 
+                if (event.type == SDL_WINDOWEVENT)
+                {
+                    presentRequired = true;
+
+                    // a new texture starts out empty, the whole frame is scaled into it
+                    if (softwareScaling && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED && ResizeUpscaledTexture())
+                        UpscaleRect(GPU::outputTexture.GetReadBuffer(), GPU::DirtyRect{0, 0, videoMode->width, videoMode->height}, *videoMode);
+                }
+
                 if (event.type == SDL_KEYDOWN)
                 {
                     if (event.key.keysym.sym == SDLK_ESCAPE)
@@ -96,25 +159,29 @@ namespace RetroSim::SDLApp
             exit(1);
         }
 
-        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING,
-                                    GPU::textureWidth, GPU::textureHeight);
-
-        if (texture == NULL)
+        softwareScaling = Core::GetInstance()->GetCoreConfig().IsSoftwareScaling();
+        if (!softwareScaling)
         {
-            printf("Could not create texture: %s\n", SDL_GetError());
-            exit(1);
-        }
+            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING,
+                                        GPU::textureWidth, GPU::textureHeight);
 
-        // Set the logical size to maintain aspect ratio
-        float aspectRatio = (float)GPU::windowWidth / (float)GPU::windowHeight;
-        SDL_RenderSetLogicalSize(renderer, GPU::windowWidth, (int)(GPU::windowWidth / aspectRatio));
+            if (texture == NULL)
+            {
+                printf("Could not create texture: %s\n", SDL_GetError());
+                exit(1);
+            }
 
-        // Set the scale to fit the window while maintaining aspect ratio
-        int windowWidth, windowHeight;
-        SDL_GetWindowSize(window, &windowWidth, &windowHeight);
-        float scaleX = (float)windowWidth / (float)GPU::windowWidth;
-        float scaleY = (float)windowHeight / (float)(GPU::windowWidth / aspectRatio);
-        SDL_RenderSetScale(renderer, scaleX, scaleY);
+            // Set the logical size to maintain aspect ratio
+            float aspectRatio = (float)GPU::windowWidth / (float)GPU::windowHeight;
+            SDL_RenderSetLogicalSize(renderer, GPU::windowWidth, (int)(GPU::windowWidth / aspectRatio));
+
+            // Set the scale to fit the window while maintaining aspect ratio
+            int windowWidth, windowHeight;
+            SDL_GetWindowSize(window, &windowWidth, &windowHeight);
+            float scaleX = (float)windowWidth / (float)GPU::windowWidth;
+            float scaleY = (float)windowHeight / (float)(GPU::windowWidth / aspectRatio);
+            SDL_RenderSetScale(renderer, scaleX, scaleY);
+        }
 
         SDL_DisplayMode displayMode;
         SDL_GetDesktopDisplayMode(0, &displayMode);
@@ -125,6 +192,71 @@ namespace RetroSim::SDLApp
 
         if (Core::GetInstance()->GetCoreConfig().IsFullScreen())
             SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+
+        if (softwareScaling)
+            ResizeUpscaledTexture();
+    }
+
+    // Picks the largest scale that fits the window, up to 4x, and centers the image. The texture is created again
+    // when the scale changes, with the border cleared; returns true then.
+    bool ResizeUpscaledTexture()
+    {
+        int outputWidth, outputHeight;
+        SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+        int newUpscale = std::clamp(std::min(outputWidth / GPU::windowWidth, outputHeight / GPU::windowHeight), 1, 4);
+
+        upscaledRect.w = GPU::windowWidth * newUpscale;
+        upscaledRect.h = GPU::windowHeight * newUpscale;
+        upscaledRect.x = (outputWidth - upscaledRect.w) / 2;
+        upscaledRect.y = (outputHeight - upscaledRect.h) / 2;
+
+        if (newUpscale == upscale)
+            return false;
+        upscale = newUpscale;
+
+        if (texture != NULL)
+            SDL_DestroyTexture(texture);
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, upscaledRect.w, upscaledRect.h);
+
+        if (texture == NULL)
+        {
+            printf("Could not create texture: %s\n", SDL_GetError());
+            exit(1);
+        }
+
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+        {
+            for (int y = 0; y < upscaledRect.h; y++)
+                std::fill_n((uint32_t *)((uint8_t *)pixels + y * pitch), upscaledRect.w, 0xFF000000);
+            SDL_UnlockTexture(texture);
+        }
+
+        return true;
+    }
+
+    // Scales a changed part of the screen into the texture. The low resolution modes cover the same area at twice the scale.
+    void UpscaleRect(const uint32_t *frame, GPU::DirtyRect rect, const GPU::VideoModeInfo &videoMode)
+    {
+        // the rest of the output texture isn't part of the screen
+        rect.width = std::min(rect.width, videoMode.width - rect.x);
+        rect.height = std::min(rect.height, videoMode.height - rect.y);
+        if (rect.width <= 0 || rect.height <= 0)
+            return;
+
+        int scale = upscale * videoMode.scale;
+        int borderX = (GPU::windowWidth - GPU::textureWidth) / 2 * upscale;
+        int borderY = (GPU::windowHeight - GPU::textureHeight) / 2 * upscale;
+        SDL_Rect target = {borderX + rect.x * scale, borderY + rect.y * scale, rect.width * scale, rect.height * scale};
+
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(texture, &target, &pixels, &pitch) != 0)
+            return;
+
+        GPU::UpscaleNearest(frame + rect.y * GPU::textureWidth + rect.x, GPU::textureWidth, rect.width, rect.height, (uint32_t *)pixels, pitch / sizeof(uint32_t), scale);
+        SDL_UnlockTexture(texture);
     }
 
     int GetScreenRefreshRate()
@@ -2,6 +2,8 @@
 // https://github.com/arcanelab
 
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <SDL.h>
 #include <SDL_gpu.h>
@@ -10,6 +12,7 @@
 #include "CoreConfig.h"
 #include "Core.h"
 #include "GPU.h"
+#include "TripleBuffer.h"
 #include "FileUtils.h"
 #include "MMU.h"
 
@@ -25,13 +28,16 @@ namespace RetroSim::SDLGPUApp
     uint32_t linkedShaders;
     GPU_ShaderBlock shaderBlock;
 
-    bool PollEvents(SDL_Event &event)
+    bool PollEvents(SDL_Event &event, bool &presentRequired)
     {
         while (SDL_PollEvent(&event))
         {
             if (event.type == SDL_QUIT)
                 return true;
 
+            if (event.type == SDL_WINDOWEVENT)
+                presentRequired = true;
+
             if (event.type == SDL_KEYDOWN)
             {
                 if (event.key.keysym.sym == SDLK_ESCAPE)
@@ -217,17 +223,74 @@ namespace RetroSim::SDLGPUApp
         windowRect.w = scaledWindowWidth;
         windowRect.h = scaledWindowHeight;
 
+        // The low resolution video modes are shown as a window of half the size, scaled up twice as much.
+        uint8_t videoMode = GPU::VIDEO_MODE_464X256;
+        int videoModeScale = 1;
+        std::vector<uint32_t> blankWindow(GPU::windowWidth * GPU::windowHeight, 0);
+
         bool quit = false;
+        bool presentRequired = true; // the window contents have to be drawn again, e.g. after being exposed
+        MMU::ShaderParameters presentedShaderParameters = MMU::memory.shaderParameters;
+        std::vector<GPU::DirtyRect> dirtyRects;
         SDL_Event event;
         while (!quit)
         {
-            quit = PollEvents(event);
-            // clear screen
-            GPU_Clear(windowRenderTarget);
+            quit = PollEvents(event, presentRequired);
             Core::GetInstance()->RunNextFrame();
             // copy texture to screen
-            GPU_UpdateImageBytes(screenTexture, &contentRect, (uint8_t *)GPU::outputTexture, GPU::textureWidth * sizeof(uint32_t));
-            GPU_BlitScale(screenTexture, NULL, upscaledTarget, 0, 0, windowScalingFactor * desktopScale, windowScalingFactor * desktopScale);
+            if (GPU::outputTexture.Acquire())
+            {
+                // only the parts changed since the last uploaded frame
+                const uint32_t *frame = GPU::outputTexture.GetReadBuffer();
+                const GPU::VideoModeInfo &info = GPU::GetVideoModeInfo(GPU::outputTexture.GetReadVideoMode());
+                if (GPU::outputTexture.GetReadVideoMode() != videoMode)
+                {
+                    // the border around the new screen may still show the previous one
+                    videoMode = GPU::outputTexture.GetReadVideoMode();
+                    videoModeScale = info.scale;
+                    contentRect.x = (GPU::windowWidth / info.scale - info.width) / 2;
+                    contentRect.y = (GPU::windowHeight / info.scale - info.height) / 2;
+                    GPU_UpdateImageBytes(screenTexture, NULL, (const uint8_t *)blankWindow.data(), GPU::windowWidth * sizeof(uint32_t));
+                    presentRequired = true;
+                }
+
+                GPU::outputTexture.GetReadDirtyRegion().GetRects(dirtyRects);
+                for (const GPU::DirtyRect &dirtyRect : dirtyRects)
+                {
+                    // the rest of the texture isn't part of the screen, it would show in the border
+                    int width = std::min(dirtyRect.width, info.width - dirtyRect.x);
+                    int height = std::min(dirtyRect.height, info.height - dirtyRect.y);
+                    if (width <= 0 || height <= 0)
+                        continue;
+
+                    GPU_Rect rect = {(float)(contentRect.x + dirtyRect.x), (float)(contentRect.y + dirtyRect.y), (float)width, (float)height};
+                    GPU_UpdateImageBytes(screenTexture, &rect, (const uint8_t *)(frame + dirtyRect.y * GPU::textureWidth + dirtyRect.x), GPU::textureWidth * sizeof(uint32_t));
+                }
+
+                if (!dirtyRects.empty())
+                    presentRequired = true;
+            }
+
+            // the shader pass depends on the parameters in memory, not just on the screen texture
+            if (std::memcmp(&presentedShaderParameters, &MMU::memory.shaderParameters, sizeof(MMU::ShaderParameters)) != 0)
+            {
+                presentedShaderParameters = MMU::memory.shaderParameters;
+                presentRequired = true;
+            }
+
+            if (!presentRequired)
+            {
+                // nothing changed, wait for the next frame instead of presenting (and waiting for vsync)
+                SDL_Delay(1000 / Core::GetInstance()->GetCoreConfig().GetFPS());
+                continue;
+            }
+            presentRequired = false;
+
+            // clear screen
+            GPU_Clear(windowRenderTarget);
+            GPU_Rect windowSourceRect = {0, 0, (float)(GPU::windowWidth / videoModeScale), (float)(GPU::windowHeight / videoModeScale)};
+            float scale = windowScalingFactor * desktopScale * videoModeScale;
+            GPU_BlitScale(screenTexture, &windowSourceRect, upscaledTarget, 0, 0, scale, scale);
 
             // Set up shader variables
             GPU_ActivateShaderProgram(linkedShaders, &shaderBlock);